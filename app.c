@@ -20,19 +20,69 @@
 #include "packet.h"
 #include "command.h"
 #include "usb_keyboard.h"
+#include "hid_cache.h"
 #include "rm_keyboard.h"
+#include "pogo_uart.h"
+#include "fw_update.h"
+#include "power.h"
+#include "crash.h"
+#include "session.h"
+#include "trace.h"
+#include "hot_path.h"
+#include "rtos.h"
+#include "cdc_stdio.h"
+#include "tap_hold.h"
+#include "clock_scaling.h"
+#include "rtt.h"
 
 app_state_t app_state;
 
 #define MAX_KEY_EVENT 10
 
+// With RMK_FREERTOS, the USB task writes and the pogo task reads, possibly on
+// the other core. Each index only has one writer.
 key_event_t key_event_queue[MAX_KEY_EVENT];
-uint8_t key_event_write_ix, key_event_read_ix;
+volatile uint8_t key_event_write_ix, key_event_read_ix;
 
-void app_push_key_event(key_event_t event) {
-  if (app_state.mode != APP_KEYBOARD) {
+// Console requests that are carried out by the pogo and the USB part of the
+// loop, which may be running in other tasks.
+static volatile bool wake_requested = false;
+static volatile int replay_requested = 0;
+
+app_stats_t app_stats;
+
+// Keys the keyboard has down, and keys the reMarkable was told are down, as
+// bitsets by HID usage. keys_held is written by the USB side in every mode, so
+// keys pressed or released while negotiating aren't lost. keys_reported only
+// changes when a key is sent.
+#define KEY_SET_WORDS (256 / 32)
+static volatile uint32_t keys_held[KEY_SET_WORDS];
+static uint32_t keys_reported[KEY_SET_WORDS];
+// HID_KEY_CONTROL_LEFT and up.
+#define MODIFIER_WORD (0xe0 / 32)
+
+static inline void key_set_update(volatile uint32_t *set, key_event_t const *event) {
+  uint32_t bit = 1u << (event->keycode % 32);
+  if (event->type == KEY_DOWN) {
+    set[event->keycode / 32] |= bit;
+  } else {
+    set[event->keycode / 32] &= ~bit;
+  }
+}
+
+// Called with the lock held. Returns false if the event wasn't queued.
+static bool RMK_HOT(app_queue_key_event)(key_event_t event) {
+  key_set_update(keys_held, &event);
+
+  bool accept = app_state.mode == APP_KEYBOARD || app_state.mode == APP_RESUMING;
+#if RMK_PIO_USB_HOST
+  // The PIO port doesn't suspend, so keys keep coming while the reMarkable
+  // sleeps, and wake it up (see app_stay_awake).
+  accept |= app_state.mode == APP_SUSPENDED;
+#endif
+  if (!accept) {
     // Ignore all data unless we're in keyboard mode.
-    return;
+    return false;
   }
 
   uint8_t next = key_event_write_ix + 1;
@@ -42,92 +92,452 @@ void app_push_key_event(key_event_t event) {
 
   if (next == key_event_read_ix) {
     // Buffer is full, discard the data.
-    return;
+    app_stats.key_events_dropped++;
+    return false;
   }
 
+  event.queued_us = time_us_32();
   key_event_queue[key_event_write_ix] = event;
+  __atomic_thread_fence(__ATOMIC_RELEASE);
   key_event_write_ix = next;
+
+  app_stats.key_events_queued++;
+  uint8_t depth = (key_event_write_ix + MAX_KEY_EVENT - key_event_read_ix) % MAX_KEY_EVENT;
+  if (depth > app_stats.max_queue_depth) {
+    app_stats.max_queue_depth = depth;
+  }
+  return true;
 }
 
-key_event_t *app_pop_key_event() {
+void RMK_HOT(app_push_key_event)(key_event_t event) {
+  // keys_held and the mode check have to agree with app_sync_keys, which
+  // looks at both from the other core with FreeRTOS.
+  rtos_lock();
+  bool queued = app_queue_key_event(event);
+  rtos_unlock();
+
+  if (queued) {
+    rtos_notify_pogo();
+  }
+}
+
+bool RMK_HOT(app_pop_key_event)(key_event_t *event) {
   if (key_event_write_ix == key_event_read_ix) {
-    return NULL; // Buffer is currently empty.
+    return false; // Buffer is currently empty.
   }
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
 
   uint8_t next = key_event_read_ix + 1;
   if (next >= MAX_KEY_EVENT) {
     next = 0;
   }
 
-  key_event_t *evt = &key_event_queue[key_event_read_ix];
+  *event = key_event_queue[key_event_read_ix];
   key_event_read_ix = next;
 
-  return evt;
+  return true;
 }
 
-int main() {
-  stdio_uart_init();
+void RMK_HOT(app_key_reported)(key_event_t const *event) {
+  key_set_update(keys_reported, event);
+}
+
+// Sends the keys of one word of the key sets as going down or up.
+static uint8_t app_sync_word(uint8_t word, uint32_t keys, key_event_type_t type) {
+  uint8_t sent = 0;
+  while (keys != 0) {
+    uint8_t bit = __builtin_ctz(keys);
+    keys &= keys - 1;
+
+    key_event_t event = {
+      .type = type,
+      .keycode = word * 32 + bit,
+      .queued_us = time_us_32()
+    };
+    // Releases are for what was reported, which is after tap-hold already.
+    if (type == KEY_DOWN) {
+      tap_hold_process_event(&event);
+    } else {
+      rmk_process_event(&event);
+    }
+    sent++;
+  }
+  return sent;
+}
+
+void app_sync_keys() {
+  // From here on, key events are queued again. Switching the mode together
+  // with taking the snapshot means that every change is either in the
+  // snapshot or in the queue afterwards, never lost in between.
+  rtos_lock();
+  if (app_state.mode == APP_RESUMING) {
+    app_state.mode = APP_KEYBOARD;
+    rtos_unlock();
+    return;
+  }
+  app_state.mode = APP_KEYBOARD;
 
+  // Everything in the queue is in keys_held already.
+  key_event_t event;
+  while (app_pop_key_event(&event)) {
+  }
+
+  uint32_t held[KEY_SET_WORDS];
+  for (uint8_t word = 0; word < KEY_SET_WORDS; word++) {
+    held[word] = keys_held[word];
+  }
+  rtos_unlock();
+
+  tap_hold_reset();
+
+  // Releases go first, then the modifiers, which are all in the last word,
+  // then the other keys, so that the reMarkable sees Shift before the B it
+  // modifies and never more keys down at once than are really held.
+  uint8_t sent = 0;
+  for (uint8_t word = 0; word < KEY_SET_WORDS; word++) {
+    sent += app_sync_word(word, keys_reported[word] & ~held[word], KEY_UP);
+  }
+  sent += app_sync_word(MODIFIER_WORD, held[MODIFIER_WORD] & ~keys_reported[MODIFIER_WORD], KEY_DOWN);
+  for (uint8_t word = 0; word < MODIFIER_WORD; word++) {
+    sent += app_sync_word(word, held[word] & ~keys_reported[word], KEY_DOWN);
+  }
+
+  app_stats.key_syncs++;
+  app_stats.keys_synced += sent;
+  app_stats.last_keys_synced = sent;
+  if (sent > 0) {
+    printf("Synced %d keys\n", sent);
+  }
+}
+
+void app_print_stats() {
+  printf("Key queue: %lu queued, %lu dropped, max depth %d of %d\n",
+    app_stats.key_events_queued, app_stats.key_events_dropped,
+    app_stats.max_queue_depth, MAX_KEY_EVENT - 1);
+  printf("Key latency: max %lu us,", app_stats.max_key_latency_us);
+  for (uint8_t i = 0; i < KEY_LATENCY_BUCKETS; i++) {
+    if (i < KEY_LATENCY_BUCKETS - 1) {
+      printf(" <%u: %lu", KEY_LATENCY_BUCKET_US(i), app_stats.key_latency[i]);
+    } else {
+      printf(" more: %lu", app_stats.key_latency[i]);
+    }
+  }
+  printf("\n");
+  printf("Key sync: %lu times, %lu keys, last %d keys\n",
+    app_stats.key_syncs, app_stats.keys_synced, app_stats.last_keys_synced);
+  printf("Suspend: %lu times, %lu woken by the keyboard, resume to first key last %lu us max %lu us\n",
+    app_stats.suspends, app_stats.keyboard_wakes, app_stats.last_resume_to_key_us,
+    app_stats.max_resume_to_key_us);
+}
+
+static void app_wake_peer() {
+  rx_switch_to_init_state();
+  pogo_uart_putc(0xff);
+  trace_record(TRACE_POGO_TX, (uint8_t const *)"\xff", 1);
+}
+
+static void app_suspend() {
+  printf("Suspending\n");
+  app_stats.suspends++;
+  hid_cache_flush();
+
+  crash_stage(CRASH_STAGE_SUSPEND);
+  crash_watchdog_pause();
+  clock_scaling_suspend_begin();
+  power_wake_t reason = power_suspend();
+  clock_scaling_suspend_end();
+  crash_watchdog_resume();
+  app_state.resumed = get_absolute_time();
+  app_state.waiting_for_key = true;
+
+  switch (reason) {
+    case POWER_WAKE_POGO:
+      printf("Woken up by the reMarkable\n");
+      app_state.mode = APP_KEYBOARD;
+      app_state.last_keep_alive = app_state.resumed;
+      break;
+
+    case POWER_WAKE_KEYBOARD:
+      // The reMarkable is still asleep. Wake it up, the key press is queued
+      // until it has entered the app again.
+      printf("Woken up by the keyboard\n");
+      app_stats.keyboard_wakes++;
+      app_state.mode = APP_RESUMING;
+      app_wake_peer();
+      break;
+
+    case POWER_WAKE_UNPLUG:
+      // Let TinyUSB see the disconnect, then go back to sleep.
+      app_state.waiting_for_key = false;
+      break;
+  }
+}
+
+// Stands in for app_suspend with RMK_PIO_USB_HOST. power_suspend needs the
+// keyboard on the native port, so we stay awake with the clocks up and the
+// PIO port running while the reMarkable sleeps. A frame from it, or a key
+// press, ends the suspend the same way as a wake-up would.
+static void app_stay_awake(bool pogo_active) {
+  static bool sleeping = false;
+  if (!sleeping) {
+    printf("Suspending, staying awake\n");
+    app_stats.suspends++;
+    hid_cache_flush();
+    sleeping = true;
+  }
+
+  if (pogo_active) {
+    printf("Woken up by the reMarkable\n");
+    app_state.mode = APP_KEYBOARD;
+    app_state.last_keep_alive = get_absolute_time();
+  } else if (key_event_write_ix != key_event_read_ix) {
+    printf("Woken up by the keyboard\n");
+    app_stats.keyboard_wakes++;
+    app_state.mode = APP_RESUMING;
+    app_wake_peer();
+  } else {
+    return;
+  }
+
+  sleeping = false;
+  app_state.resumed = get_absolute_time();
+  app_state.waiting_for_key = true;
+}
+
+static void RMK_HOT(app_key_sent)(key_event_t const *event) {
+  uint32_t latency = time_us_32() - event->queued_us;
+  uint8_t bucket = 0;
+  while (bucket < KEY_LATENCY_BUCKETS - 1 && latency >= KEY_LATENCY_BUCKET_US(bucket)) {
+    bucket++;
+  }
+  app_stats.key_latency[bucket]++;
+  if (latency > app_stats.max_key_latency_us) {
+    app_stats.max_key_latency_us = latency;
+  }
+
+  if (!app_state.waiting_for_key) {
+    return;
+  }
+  app_state.waiting_for_key = false;
+
+  uint32_t took = (uint32_t)absolute_time_diff_us(app_state.resumed, get_absolute_time());
+  app_stats.last_resume_to_key_us = took;
+  if (took > app_stats.max_resume_to_key_us) {
+    app_stats.max_resume_to_key_us = took;
+  }
+}
+
+void app_usb_init() {
+  usb_host_configure();
   if (tusb_init()) {
     printf("TinyUSB initialized: %d\n", tuh_inited());
   } else {
     printf("ERROR: TinyUSB could not be initialized\n");
   }
 
-  uart_init(uart1, 115200);
-  gpio_set_function(4, GPIO_FUNC_UART);
-  gpio_set_function(5, GPIO_FUNC_UART);
-
-  rmk_init();
+  usb_init();
+}
 
-  key_event_write_ix = key_event_read_ix = 0;
+void app_handle_console(int c) {
+  if (c == '.') {
+    wake_requested = true;
+  } else if (c == 's') {
+    app_print_stats();
+    pogo_uart_print_stats();
+    rx_print_stats();
+    tx_print_stats();
+    cmd_print_stats();
+    usb_print_report_stats();
+    usb_print_hotplug_stats();
+    trace_print_stats();
+    fw_print_stats();
+    crash_print();
+    session_print_stats();
+    xip_profile_print();
+    cdc_stdio_print_stats();
+    tap_hold_print_stats();
+    clock_scaling_print_stats();
+  } else if (c == 't') {
+    if (trace_is_running()) {
+      trace_stop();
+    } else {
+      trace_start();
+      usb_trace_layouts();
+    }
+    trace_print_stats();
+  } else if (c == 'd') {
+    trace_dump();
+  } else if (c == 'v') {
+    packet_log = !packet_log;
+    printf("Packet log %s\n", packet_log ? "on" : "off");
+  } else if (c == 'r' || c == 'R') {
+    replay_requested = c;
+  }
+}
 
-  int c;
+void app_usb_step() {
+  crash_stage(CRASH_STAGE_USB_HOST);
+#if RMK_FREERTOS
+  // Sleeps until the USB interrupt has something for us, but not for longer
+  // than a tick, so that the rest still runs regularly.
+  tuh_task_ext(1, false);
+#else
+  tuh_task();
+#endif
+  cdc_stdio_task();
+  crash_stage(CRASH_STAGE_USB);
+  usb_task();
 
-  app_state.mode = APP_NEGOTIATING;
-  app_state.last_keep_alive = nil_time;
+  if (replay_requested) {
+    usb_replay_start(replay_requested == 'r');
+    replay_requested = 0;
+  }
+  usb_replay_task();
+}
 
+void RMK_HOT(app_pogo_step)() {
+  key_event_t key_events[MAX_KEY_EVENT];
   absolute_time_t current_time = nil_time;
 
-  key_event_t *key_event = NULL;
+  if (wake_requested) {
+    wake_requested = false;
+    app_state.mode = APP_NEGOTIATING;
+    app_wake_peer();
+    printf("\n\n=====");
+  }
 
-  while (true) {
-    c = getchar_timeout_us(0);
-    if (c == '.') {
-      app_state.mode = APP_NEGOTIATING;
-      rx_switch_to_init_state();
-      uart_putc(uart1, 0xff);
-      printf("\n\n=====");
-    }
+  switch (session_task()) {
+    case SESSION_LINK_LOST:
+      // No point in sending keep-alives or keys into the void. Keys are
+      // only tracked until the reMarkable has entered the app again, and
+      // then synced (see app_sync_keys).
+      if (app_state.mode == APP_KEYBOARD || app_state.mode == APP_RESUMING) {
+        app_state.mode = APP_NEGOTIATING;
+      }
+      // Nothing can arrive from the reMarkable now, so blocking interrupts
+      // for the flash write costs no pogo bytes.
+      hid_cache_flush();
+      break;
 
-    tuh_task();
+    case SESSION_LINK_RESTORED:
+      app_wake_peer();
+      break;
 
-    if (uart_is_readable(uart1)) {
-      char data = uart_getc(uart1);
-      int packet_state = rx_process_byte((uint8_t)data);
+    default:
+      break;
+  }
+
+  crash_stage(CRASH_STAGE_POGO_RX);
+  int packet_state = RX_PACKET_RECEIVING;
+  if (rx_resync_pending()) {
+    packet_state = rx_process_pending();
+  } else if (pogo_uart_is_readable()) {
+    clock_scaling_activity();
+    xip_profile_begin();
+    uint8_t data = pogo_uart_getc();
+    trace_record(TRACE_POGO_RX, &data, 1);
+    packet_state = rx_process_byte(data);
+    xip_profile_end(XIP_PROBE_RX_BYTE);
+  }
 
-      if (packet_state == RX_PACKET_RECEIVED) {
+  if (packet_state == RX_PACKET_RECEIVED) {
+    crash_stage(CRASH_STAGE_COMMAND);
+    crash_record_packet(DIRECTION_RX, &rx_packet);
+    if (!session_answer_from_cache()) {
+      if (packet_log) {
         printf("Packet received in full.\n");
         print_packet(&rx_packet, DIRECTION_RX);
-        rx_handle_command();
-      } else if (packet_state == RX_PACKET_INVALID_CHECKSUM) {
-        printf("Packet received, but has invalid checksum.\n");
       }
+      rx_handle_command();
+      session_store_answer();
     }
+  } else if (packet_state == RX_PACKET_INVALID_CHECKSUM) {
+    printf("Packet received, but has invalid checksum.\n");
+  } else if (packet_state == RX_PACKET_INVALID_FRAME) {
+    printf("Packet header is invalid.\n");
+  }
 
-    if (app_state.mode == APP_KEYBOARD) {
-      while ((key_event = app_pop_key_event()) != NULL) {
-        printf("Received key event: %d %d\n", key_event->type, key_event->keycode);
-        rmk_process_event(key_event);
+  crash_stage(CRASH_STAGE_KEYS);
+  if (app_state.mode == APP_KEYBOARD) {
+    // Everything that's queued goes out in one write, which matters with
+    // several keys changing in one report.
+    uint8_t sent = 0;
+    tx_batch_begin();
+    tap_hold_task();
+    while (sent < MAX_KEY_EVENT && app_pop_key_event(&key_events[sent])) {
+      if (packet_log) {
+        printf("Received key event: %d %d\n", key_events[sent].type, key_events[sent].keycode);
       }
+      xip_profile_begin();
+      tap_hold_process_event(&key_events[sent]);
+      xip_profile_end(XIP_PROBE_KEY_EVENT);
+      sent++;
+    }
 
-      current_time = get_absolute_time();
-      if (absolute_time_diff_us(app_state.last_keep_alive, current_time) > 400000) {
-        cmd_send_keep_alive();
-        app_state.last_keep_alive = current_time;
-      }
+    current_time = get_absolute_time();
+    if (absolute_time_diff_us(app_state.last_keep_alive, current_time) > 400000) {
+      cmd_send_keep_alive();
+      app_state.last_keep_alive = current_time;
     }
+    tx_batch_flush();
+
+    for (uint8_t i = 0; i < sent; i++) {
+      app_key_sent(&key_events[i]);
+    }
+  } else if (app_state.mode == APP_SUSPENDED) {
+#if RMK_PIO_USB_HOST
+    app_stay_awake(packet_state != RX_PACKET_RECEIVING);
+#else
+    app_suspend();
+#endif
+  }
+
+  clock_scaling_task();
+}
+
+int main() {
+  power_init();
+
+#if RMK_PIO_USB_HOST
+  set_sys_clock_khz(POWER_SYS_CLOCK_KHZ, true);
+  cdc_stdio_init();
+#elif !RMK_RTT
+  stdio_uart_init();
+#endif
+  rtt_init();
+
+  // If we crashed while working as a keyboard, the reMarkable hasn't noticed
+  // yet. Carry on where we were instead of waiting for a new handshake.
+  bool resume = crash_init();
+
+  pogo_uart_init();
+  xip_profile_init();
+
+  key_event_write_ix = key_event_read_ix = 0;
+
+  // In keyboard mode, nil_time makes us send a keep-alive right away.
+  app_state.mode = resume ? APP_KEYBOARD : APP_NEGOTIATING;
+  app_state.last_keep_alive = nil_time;
+  if (resume) {
+    printf("Resuming keyboard mode after crash\n");
+  }
+
+  // TinyUSB's interrupt goes to the core that calls tusb_init. That's core 0
+  // with FreeRTOS as well, where power_suspend masks it.
+  app_usb_init();
+
+#if RMK_FREERTOS
+  rtos_start();
+#else
+  crash_watchdog_start();
+
+  while (true) {
+    crash_loop(app_state.mode);
+    app_handle_console(getchar_timeout_us(0));
+    app_usb_step();
+    app_pogo_step();
   }
+#endif
 
   return 0;
 }
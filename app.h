@@ -19,16 +19,42 @@
 
 typedef enum app_mode {
   APP_NEGOTIATING = 0,
-  APP_KEYBOARD = 1
+  APP_KEYBOARD = 1,
+  APP_SUSPENDED = 2, // The reMarkable sent CMD_ENTER_SUSPEND.
+  APP_RESUMING = 3 // Woken by a key press, waiting for the handshake to finish.
 } app_mode_t;
 
 typedef struct app_state {
   app_mode_t mode;
   absolute_time_t last_keep_alive;
+  absolute_time_t resumed; // When we last woke up from suspend.
+  bool waiting_for_key; // No key sent since resuming.
 } app_state_t;
 
 extern app_state_t app_state;
 
+#define KEY_LATENCY_BUCKETS 8
+#define KEY_LATENCY_BUCKET_US(i) (64u << (i))
+
+typedef struct app_stats {
+  uint32_t key_events_queued;
+  uint32_t key_events_dropped; // Because the queue was full.
+  uint8_t max_queue_depth;
+  uint32_t suspends;
+  uint32_t keyboard_wakes;
+  uint32_t last_resume_to_key_us;
+  uint32_t max_resume_to_key_us;
+  // From queueing a key event to its frame going out. The buckets double,
+  // the last one takes everything from 4 ms up.
+  uint32_t key_latency[KEY_LATENCY_BUCKETS];
+  uint32_t max_key_latency_us;
+  uint32_t key_syncs;
+  uint32_t keys_synced; // Key events sent by all of them.
+  uint8_t last_keys_synced;
+} app_stats_t;
+
+extern app_stats_t app_stats;
+
 typedef enum key_event_type {
   KEY_UP = 0,
   KEY_DOWN = 1
@@ -37,16 +63,40 @@ typedef enum key_event_type {
 typedef struct key_event {
   key_event_type_t type;
   uint8_t keycode; // TinyUSB HID_KEY_* constants.
+  uint32_t queued_us; // Set by app_push_key_event.
 } key_event_t;
 
 // Push a keyboard event onto the queue. This discards data if the maximum
-// queue capacity has been reached.
+// queue capacity has been reached. Events are only queued in keyboard mode,
+// and while resuming, so the key press that woke us up isn't lost. The set of
+// keys that are down is kept up to date in every mode.
 void app_push_key_event(key_event_t event);
 
-// Pop a keyboard event off of the queue. This returns NULL if the queue is
-// empty. Note that you should use the return value immediately, since the
-// location it points to may be overwritten soon (this should be fine since
-// this is all running in a single execution thread anyway...).
-key_event_t *app_pop_key_event();
+// Pop a keyboard event off of the queue into *event. This returns false if
+// the queue is empty. The event is copied out, since with RMK_FREERTOS the
+// USB task may reuse its slot right away.
+bool app_pop_key_event(key_event_t *event);
+
+// Records a key event sent to the reMarkable, by the HID usage it was sent
+// for (after tap-hold).
+void app_key_reported(key_event_t const *event);
+
+// Brings the reMarkable up to date with the keys that are down, after a
+// handshake. Whatever was queued is dropped, and only the keys that changed
+// since it was last told are sent, in one write together with whatever frame
+// was written before within the same tx_batch. When resuming, the queue
+// already has the key that woke us up and is kept instead. Either way, this
+// switches to APP_KEYBOARD.
+void app_sync_keys();
+
+void app_print_stats();
+
+// One pass of each part of the main loop. The bare metal build calls them in
+// turn, with RMK_FREERTOS they run in separate tasks (see rtos.h). Console
+// commands that need the pogo or the USB side are handed over to them.
+void app_usb_init();
+void app_handle_console(int c);
+void app_usb_step();
+void app_pogo_step();
 
 #endif
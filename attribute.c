@@ -65,7 +65,7 @@ void tx_add_enum8_attribute(attribute_id_t attribute_id, uint8_t value) {
   tx_packet.data[tx_packet.data_length++] = value;
 }
 
-void tx_add_string_attribute(attribute_id_t attribute_id, char *string) {
+void tx_add_string_attribute(attribute_id_t attribute_id, const char *string) {
   assert(tx_packet.data_length + ATTR_HEADER_LENGTH + 1 + strlen(string) < MAX_PACKET_DATA);
 
   tx_add_attribute_header(attribute_id, ATTR_TYPE_STRING);
@@ -74,7 +74,7 @@ void tx_add_string_attribute(attribute_id_t attribute_id, char *string) {
   tx_packet.data_length += strlen(string);
 }
 
-void tx_add_int32_array_attribute(attribute_id_t attribute_id, int32_t *data, size_t len) {
+void tx_add_int32_array_attribute(attribute_id_t attribute_id, int32_t const *data, size_t len) {
   size_t actual_len = len * 4;
   assert(tx_packet.data_length + ATTR_HEADER_LENGTH + 3 + actual_len < MAX_PACKET_DATA);
 
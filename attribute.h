@@ -43,13 +43,20 @@ typedef enum attribute_type {
   ATTR_TYPE_ARRAY = 0x48
 } attribute_type_t;
 
+// Answer to CMD_ATTRIBUTE_WRITE.
+typedef enum attribute_status {
+  ATTR_OK = 0,
+  ATTR_ERROR_UNSUPPORTED = 1, // Unknown or read-only attribute.
+  ATTR_ERROR_TYPE = 2 // Wrong type or length for this attribute.
+} attribute_status_t;
+
 void tx_add_attribute_header(attribute_id_t attribute_id, attribute_type_t type);
 void tx_add_int32_attribute(attribute_id_t attribute_id, int32_t value);
 void tx_add_uint8_attribute(attribute_id_t attribute_id, uint8_t value);
 void tx_add_uint16_attribute(attribute_id_t attribute_id, uint16_t value);
 void tx_add_uint32_attribute(attribute_id_t attribute_id, uint32_t value);
 void tx_add_enum8_attribute(attribute_id_t attribute_id, uint8_t value);
-void tx_add_string_attribute(attribute_id_t attribute_id, char *string);
-void tx_add_int32_array_attribute(attribute_id_t attribute_id, int32_t *data, size_t len);
+void tx_add_string_attribute(attribute_id_t attribute_id, const char *string);
+void tx_add_int32_array_attribute(attribute_id_t attribute_id, int32_t const *data, size_t len);
 
 #endif
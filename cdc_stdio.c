@@ -0,0 +1,112 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include "pico/stdlib.h"
+
+#include "config.h"
+#include "cdc_stdio.h"
+
+#if RMK_PIO_USB_HOST
+
+#include "pico/stdio/driver.h"
+#include "tusb.h"
+
+// How long printing waits for the terminal to make room in the TX FIFO before
+// it starts dropping output.
+#define CDC_STDIO_WAIT_US 2000
+
+static cdc_stdio_stats_t cdc_stdio_stats;
+
+// Set when waiting for room timed out, cleared once half the FIFO is free
+// again. Until then output is dropped right away, so a terminal that stopped
+// reading doesn't hold up every printf.
+static bool dropping = false;
+
+static bool cdc_stdio_has_room() {
+  if (dropping && tud_cdc_write_available() >= CFG_TUD_CDC_TX_BUFSIZE / 2) {
+    dropping = false;
+  }
+  return !dropping;
+}
+
+static void cdc_stdio_out_chars(const char *buf, int length) {
+  if (!tud_inited() || !cdc_stdio_has_room()) {
+    cdc_stdio_stats.dropped += length;
+    return;
+  }
+
+  // While no terminal is connected, TinyUSB overwrites the oldest data, so
+  // this only ever waits for a terminal that's there but slow.
+  absolute_time_t deadline = make_timeout_time_us(CDC_STDIO_WAIT_US);
+  while (true) {
+    uint32_t written = tud_cdc_write(buf, length);
+    cdc_stdio_stats.bytes += written;
+    buf += written;
+    length -= written;
+    if (length == 0) {
+      return;
+    }
+
+    if (time_reached(deadline)) {
+      dropping = true;
+      cdc_stdio_stats.stalls++;
+      cdc_stdio_stats.dropped += length;
+      return;
+    }
+    tud_cdc_write_flush();
+    tud_task();
+  }
+}
+
+static void cdc_stdio_out_flush() {
+  if (tud_inited()) {
+    tud_cdc_write_flush();
+  }
+}
+
+static int cdc_stdio_in_chars(char *buf, int length) {
+  if (!tud_inited() || !tud_cdc_available()) {
+    return PICO_ERROR_NO_DATA;
+  }
+  int read = tud_cdc_read(buf, length);
+  return read > 0 ? read : PICO_ERROR_NO_DATA;
+}
+
+static stdio_driver_t cdc_stdio_driver = {
+  .out_chars = cdc_stdio_out_chars,
+  .out_flush = cdc_stdio_out_flush,
+  .in_chars = cdc_stdio_in_chars,
+#if PICO_STDIO_ENABLE_CRLF_SUPPORT
+  .crlf_enabled = PICO_STDIO_DEFAULT_CRLF
+#endif
+};
+
+void cdc_stdio_init() {
+  tud_init(BOARD_TUD_RHPORT);
+  stdio_set_driver_enabled(&cdc_stdio_driver, true);
+}
+
+void cdc_stdio_task() {
+  tud_task();
+  tud_cdc_write_flush();
+}
+
+void cdc_stdio_print_stats() {
+  printf("CDC console: %s, %lu bytes, %lu dropped, %lu stalls\n",
+    tud_cdc_connected() ? "connected" : "not connected",
+    cdc_stdio_stats.bytes, cdc_stdio_stats.dropped, cdc_stdio_stats.stalls);
+}
+
+#endif
@@ -0,0 +1,61 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _CDC_STDIO_H
+#define _CDC_STDIO_H
+
+#include "pico/stdlib.h"
+#include "config.h"
+
+// With RMK_PIO_USB_HOST, the native USB controller is free and shows up on
+// the computer as a CDC serial port, which replaces the debug UART for stdio:
+// logs, statistics, trace dumps and the console commands. TinyUSB buffers the
+// output and sends it from tud_task, so printing doesn't wait for the text to
+// go out, and a trace dump goes at full speed USB rates instead of 115200
+// baud.
+//
+// Until a terminal opens the port, the most recent output is kept in the CDC
+// FIFO and sent once it does. If the terminal stops reading, printing waits a
+// little for room once and then drops output until the FIFO has drained.
+
+typedef struct cdc_stdio_stats {
+  uint32_t bytes; // Handed to TinyUSB.
+  uint32_t dropped; // Because the terminal didn't keep up.
+  uint32_t stalls; // Times printing gave up waiting for room.
+} cdc_stdio_stats_t;
+
+#if RMK_PIO_USB_HOST
+
+// Brings up the device side of TinyUSB and makes the CDC port the stdio
+// driver. Call this before anything is printed, the host side is set up
+// later by tusb_init.
+void cdc_stdio_init();
+
+// Runs the device stack and pushes out what was printed. Call this from the
+// main loop.
+void cdc_stdio_task();
+
+void cdc_stdio_print_stats();
+
+#else
+
+static inline void cdc_stdio_task() {
+}
+
+static inline void cdc_stdio_print_stats() {
+}
+
+#endif
+
+#endif
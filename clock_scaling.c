@@ -0,0 +1,130 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include "pico/stdlib.h"
+
+#include "clock_scaling.h"
+#include "hot_path.h"
+
+// Rough supply current of a Pico in each state, in mA, with the USB host
+// running and without what the keyboard draws. The loop never sleeps while
+// awake, so this goes with clk_sys.
+static const uint8_t clock_current_ma[POWER_CLOCKS] = {
+  [POWER_CLOCK_FULL] = 24,
+  [POWER_CLOCK_IDLE] = 12,
+  [POWER_CLOCK_SUSPEND] = 5
+};
+
+static const char *const clock_names[POWER_CLOCKS] = {
+  [POWER_CLOCK_FULL] = "full",
+  [POWER_CLOCK_IDLE] = "idle",
+  [POWER_CLOCK_SUSPEND] = "suspend"
+};
+
+clock_scaling_stats_t clock_scaling_stats;
+
+static power_clock_t clock_state = POWER_CLOCK_FULL;
+static uint64_t clock_state_since_us = 0;
+static volatile uint32_t last_activity_us = 0;
+
+static void RMK_HOT(clock_scaling_enter)(power_clock_t state) {
+  uint64_t now = time_us_64();
+  clock_scaling_stats.residency_us[clock_state] += now - clock_state_since_us;
+  clock_state_since_us = now;
+  clock_state = state;
+}
+
+void RMK_HOT(clock_scaling_activity)() {
+  last_activity_us = time_us_32();
+#if RMK_IDLE_CLOCK_MS
+  if (clock_state != POWER_CLOCK_IDLE) {
+    return;
+  }
+
+  power_set_clock(POWER_CLOCK_FULL);
+  clock_scaling_enter(POWER_CLOCK_FULL);
+
+  uint32_t took = time_us_32() - last_activity_us;
+  clock_scaling_stats.boosts++;
+  clock_scaling_stats.last_boost_us = took;
+  if (took > clock_scaling_stats.max_boost_us) {
+    clock_scaling_stats.max_boost_us = took;
+  }
+#endif
+}
+
+void clock_scaling_task() {
+#if RMK_IDLE_CLOCK_MS
+  if (clock_state != POWER_CLOCK_FULL ||
+      time_us_32() - last_activity_us < RMK_IDLE_CLOCK_MS * 1000) {
+    return;
+  }
+
+  power_set_clock(POWER_CLOCK_IDLE);
+  clock_scaling_enter(POWER_CLOCK_IDLE);
+  clock_scaling_stats.idles++;
+#endif
+}
+
+void clock_scaling_suspend_begin() {
+  clock_scaling_enter(POWER_CLOCK_SUSPEND);
+}
+
+void clock_scaling_suspend_end() {
+  clock_scaling_enter(POWER_CLOCK_FULL);
+  last_activity_us = time_us_32();
+}
+
+static uint64_t clock_scaling_total_us() {
+  // Brings the current state's residency up to date.
+  clock_scaling_enter(clock_state);
+
+  uint64_t total_us = 0;
+  for (uint8_t i = 0; i < POWER_CLOCKS; i++) {
+    total_us += clock_scaling_stats.residency_us[i];
+  }
+  return total_us;
+}
+
+uint32_t clock_scaling_average_ua() {
+  uint64_t total_us = clock_scaling_total_us();
+  if (total_us == 0) {
+    return 0;
+  }
+
+  uint64_t charge = 0;
+  for (uint8_t i = 0; i < POWER_CLOCKS; i++) {
+    charge += clock_scaling_stats.residency_us[i] * clock_current_ma[i] * 1000;
+  }
+  return (uint32_t)(charge / total_us);
+}
+
+void clock_scaling_print_stats() {
+  uint64_t total_us = clock_scaling_total_us();
+  if (total_us == 0) {
+    return;
+  }
+  uint32_t average_ua = clock_scaling_average_ua();
+
+  printf("Clock:");
+  for (uint8_t i = 0; i < POWER_CLOCKS; i++) {
+    printf(" %s %lu.%lu%%,", clock_names[i],
+      (uint32_t)(clock_scaling_stats.residency_us[i] * 100 / total_us),
+      (uint32_t)(clock_scaling_stats.residency_us[i] * 1000 / total_us % 10));
+  }
+  printf(" %lu idles, %lu boosts, boost last %lu us max %lu us, about %lu.%lu mA\n",
+    clock_scaling_stats.idles, clock_scaling_stats.boosts, clock_scaling_stats.last_boost_us,
+    clock_scaling_stats.max_boost_us, average_ua / 1000, average_ua / 100 % 10);
+}
@@ -0,0 +1,58 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _CLOCK_SCALING_H
+#define _CLOCK_SCALING_H
+
+#include "pico/stdlib.h"
+#include "config.h"
+#include "power.h"
+
+// With RMK_IDLE_CLOCK_MS, clk_sys drops to 48 MHz once neither the keyboard
+// nor the reMarkable has sent anything for that long, which is most of the
+// time: keep-alives only go out from us. The first HID report or received
+// byte switches it back to full speed. Only clk_sys changes, clk_usb and
+// clk_peri stay on the USB PLL, so USB and the UARTs don't notice.
+//
+// The time spent in each clock state is counted either way, and gives a
+// rough estimate of the average current of the board.
+
+typedef struct clock_scaling_stats {
+  uint64_t residency_us[POWER_CLOCKS];
+  uint32_t idles;
+  uint32_t boosts;
+  // From noticing the activity to running at full speed again.
+  uint32_t last_boost_us;
+  uint32_t max_boost_us;
+} clock_scaling_stats_t;
+
+extern clock_scaling_stats_t clock_scaling_stats;
+
+// Call for every HID report and every byte received from the reMarkable.
+void clock_scaling_activity();
+
+// Drops the clock once it's been idle for long enough. Call this from the main
+// loop.
+void clock_scaling_task();
+
+// Call around power_suspend, which brings the clocks back to full speed.
+void clock_scaling_suspend_begin();
+void clock_scaling_suspend_end();
+
+// Average current since boot estimated from the residency, in uA.
+uint32_t clock_scaling_average_ua();
+
+void clock_scaling_print_stats();
+
+#endif
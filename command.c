@@ -12,6 +12,7 @@
  * GNU General Public License for more details.
  */
 
+#include <assert.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -19,36 +20,111 @@
 #include "packet.h"
 #include "attribute.h"
 #include "command.h"
+#include "fw_update.h"
+#include "pogo_uart.h"
+#include "crash.h"
+#include "session.h"
+#include "hot_path.h"
 
 // These are the values that we're returning as responses to attribute reads.
-static char *DATA_DEVICE_NAME = "rMkeyboard01";
-static char *DATA_SERIAL_NUMBER = "RM712-311-11212";
-static int32_t DATA_DEVICE_ID[] = { 0x3011040, 0xafaea528, 0x14160517, 0xf5000510 };
-static uint16_t DATA_FIRMWARE_VERSION = 0x102;
-static uint8_t DATA_LANGUAGE = 0x01;
-static int32_t DATA_DEVICE_CLASS = 0x80000002;
-static uint32_t DATA_IMAGE_START_ADDRESS = 0x40000;
-static uint8_t DATA_KEY_LAYOUT = 0x01;
-static char *DATA_AUTH_KEY = "@O8eO77%o^4*1GE@oeodd#WMa%8Kr6v@";
+static const char DATA_DEVICE_NAME[] = "rMkeyboard01";
+static const char DATA_SERIAL_NUMBER[] = "RM712-311-11212";
+static const int32_t DATA_DEVICE_ID[] = { 0x3011040, 0xafaea528, 0x14160517, 0xf5000510 };
+static const uint16_t DATA_FIRMWARE_VERSION = 0x102;
+static const int32_t DATA_DEVICE_CLASS = 0x80000002;
+static const uint32_t DATA_IMAGE_START_ADDRESS = 0x40000;
+static const char DATA_AUTH_KEY[] = "@O8eO77%o^4*1GE@oeodd#WMa%8Kr6v@";
 
-void rx_handle_command() {
-  switch (rx_packet.command) {
-    case CMD_ATTRIBUTE_READ:
-      cmd_handle_attribute_read();
-      break;
+// These two can be changed with CMD_ATTRIBUTE_WRITE.
+static uint8_t data_language = 0x01;
+static uint8_t data_key_layout = 0x01;
 
-    case CMD_GET_AUTH_KEY:
-      cmd_handle_get_auth_key();
-      break;
+enum cmd_slot {
+  SLOT_UNKNOWN = CMD_SLOT_UNKNOWN,
+  SLOT_NONE,
+  SLOT_FW_WRITE_VALIDATE_IMAGE,
+  SLOT_ENTER_APP,
+  SLOT_ENTER_SUSPEND,
+  SLOT_FW_WRITE_VALIDATE_CRC,
+  SLOT_FW_WRITE_PACKET,
+  SLOT_FW_WRITE_INIT,
+  SLOT_GET_AUTH_KEY,
+  SLOT_REBOOT,
+  SLOT_ATTRIBUTE_READ,
+  SLOT_ATTRIBUTE_WRITE,
+  SLOT_REPORT_ALIVE,
+  SLOT_REPORT_KEY,
+  SLOT_COUNT
+};
 
-    case CMD_ENTER_APP:
-      cmd_handle_enter_app();
-      break;
+static_assert(SLOT_COUNT == CMD_SLOTS, "CMD_SLOTS has to match enum cmd_slot");
 
-    default:
-      printf("ERROR: Do not know how to handle command: %s\n", command_name(rx_packet.command));
-      break;
+// Checked by the parser for every frame header, so it goes along with the hot
+// path.
+const uint8_t RMK_HOT_DATA(cmd_index)[256] = {
+  [CMD_NONE] = SLOT_NONE,
+  [CMD_FW_WRITE_VALIDATE_IMAGE] = SLOT_FW_WRITE_VALIDATE_IMAGE,
+  [CMD_ENTER_APP] = SLOT_ENTER_APP,
+  [CMD_ENTER_SUSPEND] = SLOT_ENTER_SUSPEND,
+  [CMD_FW_WRITE_VALIDATE_CRC] = SLOT_FW_WRITE_VALIDATE_CRC,
+  [CMD_FW_WRITE_PACKET] = SLOT_FW_WRITE_PACKET,
+  [CMD_FW_WRITE_INIT] = SLOT_FW_WRITE_INIT,
+  [CMD_GET_AUTH_KEY] = SLOT_GET_AUTH_KEY,
+  [CMD_REBOOT] = SLOT_REBOOT,
+  [CMD_ATTRIBUTE_READ] = SLOT_ATTRIBUTE_READ,
+  [CMD_ATTRIBUTE_WRITE] = SLOT_ATTRIBUTE_WRITE,
+  [CMD_REPORT_ALIVE] = SLOT_REPORT_ALIVE,
+  [CMD_REPORT_KEY] = SLOT_REPORT_KEY
+};
+
+// Commands whose payload we don't look at accept anything up to
+// MAX_PACKET_DATA.
+const cmd_descriptor_t cmd_descriptors[CMD_SLOTS] = {
+  [SLOT_UNKNOWN] = { NULL, "UNKNOWN", 0, 0 },
+  [SLOT_NONE] = { cmd_handle_none, "CMD_NONE", 0, MAX_PACKET_DATA },
+  [SLOT_FW_WRITE_VALIDATE_IMAGE] = { cmd_handle_fw_write_validate_image, "CMD_FW_WRITE_VALIDATE_IMAGE", 0, 0 },
+  [SLOT_ENTER_APP] = { cmd_handle_enter_app, "CMD_ENTER_APP", 0, MAX_PACKET_DATA },
+  [SLOT_ENTER_SUSPEND] = { cmd_handle_enter_suspend, "CMD_ENTER_SUSPEND", 0, MAX_PACKET_DATA },
+  [SLOT_FW_WRITE_VALIDATE_CRC] = { cmd_handle_fw_write_validate_crc, "CMD_FW_WRITE_VALIDATE_CRC", 4, 4 },
+  [SLOT_FW_WRITE_PACKET] = { cmd_handle_fw_write_packet, "CMD_FW_WRITE_PACKET", 4, MAX_PACKET_DATA },
+  [SLOT_FW_WRITE_INIT] = { cmd_handle_fw_write_init, "CMD_FW_WRITE_INIT", 4, 4 },
+  [SLOT_GET_AUTH_KEY] = { cmd_handle_get_auth_key, "CMD_GET_AUTH_KEY", 0, MAX_PACKET_DATA },
+  [SLOT_REBOOT] = { cmd_handle_reboot, "CMD_REBOOT", 0, MAX_PACKET_DATA },
+  [SLOT_ATTRIBUTE_READ] = { cmd_handle_attribute_read, "CMD_ATTRIBUTE_READ", 1, MAX_PACKET_DATA },
+  [SLOT_ATTRIBUTE_WRITE] = { cmd_handle_attribute_write, "CMD_ATTRIBUTE_WRITE", ATTR_HEADER_LENGTH + 1, MAX_PACKET_DATA },
+  [SLOT_REPORT_ALIVE] = { cmd_handle_report, "CMD_REPORT_ALIVE", 0, MAX_PACKET_DATA },
+  [SLOT_REPORT_KEY] = { cmd_handle_report, "CMD_REPORT_KEY", 2, 2 }
+};
+
+cmd_counters_t cmd_counters[CMD_SLOTS];
+
+const char *command_name(uint8_t command) {
+  return cmd_descriptors[cmd_index[command]].name;
+}
+
+void rx_handle_command() {
+  uint8_t slot = cmd_index[rx_packet.command];
+  cmd_descriptor_t const *descriptor = &cmd_descriptors[slot];
+
+  if (descriptor->handler == NULL) {
+    cmd_counters[slot].rejected++;
+    printf("ERROR: Do not know how to handle command: %x\n", rx_packet.command);
+    return;
   }
+
+  if (rx_packet.data_length < descriptor->min_length || rx_packet.data_length > descriptor->max_length) {
+    cmd_counters[slot].rejected++;
+    printf("ERROR: %s with %u bytes of data, expected %u to %u\n", descriptor->name,
+           rx_packet.data_length, descriptor->min_length, descriptor->max_length);
+    return;
+  }
+
+  cmd_counters[slot].handled++;
+  descriptor->handler();
+}
+
+void cmd_handle_none() {
+  // Nothing to do, and the kernel driver doesn't expect an answer.
 }
 
 void cmd_handle_attribute_read() {
@@ -72,7 +148,7 @@ void cmd_handle_attribute_read() {
         break;
       
       case ATTR_LANGUAGE:
-        tx_add_enum8_attribute(ATTR_LANGUAGE, DATA_LANGUAGE);
+        tx_add_enum8_attribute(ATTR_LANGUAGE, data_language);
         break;
 
       case ATTR_DEVICE_CLASS:
@@ -84,7 +160,7 @@ void cmd_handle_attribute_read() {
         break;
 
       case ATTR_KEY_LAYOUT:
-        tx_add_uint8_attribute(ATTR_KEY_LAYOUT, DATA_KEY_LAYOUT);
+        tx_add_uint8_attribute(ATTR_KEY_LAYOUT, data_key_layout);
         break;
 
       case ATTR_DEVICE_ID:
@@ -104,6 +180,53 @@ void cmd_handle_attribute_read() {
   tx_write_packet();
 }
 
+void cmd_handle_attribute_write() {
+  // One attribute laid out like in the answer to a read: the ID, a NULL byte,
+  // the data type and the value. Only the language and the key layout can be
+  // written. The kernel driver never sends this, so the layout is a guess.
+  // We answer with the same command and one attribute_status_t byte.
+  attribute_id_t attr_id = (attribute_id_t)rx_packet.data[0];
+  attribute_type_t type = (attribute_type_t)rx_packet.data[2];
+  uint8_t const *value = &rx_packet.data[ATTR_HEADER_LENGTH];
+  bool single_byte = rx_packet.data[1] == 0x00 && rx_packet.data_length == ATTR_HEADER_LENGTH + 1;
+  attribute_status_t status = ATTR_OK;
+
+  switch (attr_id) {
+    case ATTR_LANGUAGE:
+      if (type != ATTR_TYPE_ENUM8 || !single_byte) {
+        status = ATTR_ERROR_TYPE;
+      } else {
+        data_language = value[0];
+      }
+      break;
+
+    case ATTR_KEY_LAYOUT:
+      if (type != ATTR_TYPE_UINT8 || !single_byte) {
+        status = ATTR_ERROR_TYPE;
+      } else {
+        data_key_layout = value[0];
+      }
+      break;
+
+    default:
+      status = ATTR_ERROR_UNSUPPORTED;
+      break;
+  }
+
+  if (status == ATTR_OK) {
+    // The cached answers to attribute reads are stale now.
+    session_invalidate();
+  } else {
+    printf("ERROR: Cannot write attribute %x, status %d\n", attr_id, status);
+  }
+
+  tx_packet.command = CMD_ATTRIBUTE_WRITE;
+  tx_packet.data_length = 1;
+  tx_packet.data[0] = (uint8_t)status;
+
+  tx_write_packet();
+}
+
 void cmd_handle_get_auth_key() {
   tx_packet.command = CMD_GET_AUTH_KEY;
   // Auth key expects a NULL terminator.
@@ -117,20 +240,83 @@ void cmd_handle_enter_app() {
   tx_packet.command = CMD_ENTER_APP;
   tx_packet.data_length = 0;
 
+  // The answer and the keys that changed in the meantime go out in one write.
+  // Syncing the keys also switches to keyboard mode.
+  tx_batch_begin();
   tx_write_packet();
+  app_sync_keys();
+  tx_batch_flush();
 
-  app_state.mode = APP_KEYBOARD;
   app_state.last_keep_alive = get_absolute_time();
+  session_entered_app();
 }
 
-void cmd_send_keep_alive() {
+void cmd_handle_enter_suspend() {
+  tx_packet.command = CMD_ENTER_SUSPEND;
+  tx_packet.data_length = 0;
+
+  tx_write_packet();
+
+  // The main loop suspends once it's done with this iteration.
+  app_state.mode = APP_SUSPENDED;
+}
+
+void cmd_handle_reboot() {
+  tx_packet.command = CMD_REBOOT;
+  tx_packet.data_length = 0;
+
+  tx_write_packet();
+  pogo_uart_tx_wait();
+
+  printf("Rebooting\n");
+  crash_reboot();
+
+  // Only the simulator gets here. Start over as if we had rebooted.
+  app_state.mode = APP_NEGOTIATING;
+  session_invalidate();
+}
+
+static void fw_answer(fw_status_t status) {
+  if (status != FW_OK) {
+    printf("ERROR: %s failed with status %d\n", command_name(rx_packet.command), status);
+  }
+
+  tx_packet.command = rx_packet.command;
+  tx_packet.data_length = 1;
+  tx_packet.data[0] = (uint8_t)status;
+
+  tx_write_packet();
+}
+
+void cmd_handle_fw_write_init() {
+  fw_answer(fw_write_init(rx_packet.data, rx_packet.data_length));
+}
+
+void cmd_handle_fw_write_packet() {
+  fw_answer(fw_write_packet(rx_packet.data, rx_packet.data_length));
+}
+
+void cmd_handle_fw_write_validate_crc() {
+  fw_answer(fw_write_validate_crc(rx_packet.data, rx_packet.data_length));
+}
+
+void cmd_handle_fw_write_validate_image() {
+  fw_answer(fw_write_validate_image());
+}
+
+void cmd_handle_report() {
+  // These only ever go from us to the reMarkable. Seeing one here means the
+  // line echoes, there's nothing to answer.
+}
+
+void RMK_HOT(cmd_send_keep_alive)() {
   tx_packet.command = CMD_REPORT_ALIVE;
   tx_packet.data_length = 0;
 
   tx_write_packet();
 }
 
-void cmd_send_key(key_event_type_t type, uint8_t keycode) {
+void RMK_HOT(cmd_send_key)(key_event_type_t type, uint8_t keycode) {
   tx_packet.command = CMD_REPORT_KEY;
   tx_packet.data_length = 2;
   tx_packet.data[0] = keycode | (uint8_t)type;
@@ -138,3 +324,14 @@ void cmd_send_key(key_event_type_t type, uint8_t keycode) {
 
   tx_write_packet();
 }
+
+void cmd_print_stats() {
+  printf("Commands:");
+  for (uint8_t slot = 0; slot < CMD_SLOTS; slot++) {
+    cmd_counters_t const *counters = &cmd_counters[slot];
+    if (counters->handled || counters->rejected) {
+      printf(" %s %lu/%lu", cmd_descriptors[slot].name, counters->handled, counters->rejected);
+    }
+  }
+  printf(" (handled/rejected)\n");
+}
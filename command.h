@@ -17,15 +17,62 @@
 
 #include "app.h"
 
+// Every command byte maps to a slot in cmd_descriptors, CMD_SLOT_UNKNOWN for
+// the ones we don't know. Both tables are const. cmd_descriptors stays in
+// flash, cmd_index is looked up for every frame and moves to SRAM with
+// RMK_RAM_HOT_PATH (see hot_path.h). The counters are in RAM.
+#define CMD_SLOT_UNKNOWN 0
+#define CMD_SLOTS 14
+
+typedef void (*cmd_handler_t)();
+
+typedef struct cmd_descriptor {
+  cmd_handler_t handler;
+  const char *name;
+  // Payload length range, frames outside of it never reach the handler.
+  uint8_t min_length;
+  uint8_t max_length;
+} cmd_descriptor_t;
+
+typedef struct cmd_counters {
+  uint32_t handled;
+  uint32_t rejected; // Unknown command or payload length out of range.
+} cmd_counters_t;
+
+extern const uint8_t cmd_index[256];
+extern const cmd_descriptor_t cmd_descriptors[CMD_SLOTS];
+extern cmd_counters_t cmd_counters[CMD_SLOTS];
+
+static inline bool cmd_is_known(uint8_t command) {
+  return cmd_index[command] != CMD_SLOT_UNKNOWN;
+}
+
+const char *command_name(uint8_t command);
+
 // Handle the command that's currently in rx_packet. Caller has to make sure
 // that receiving has finished and that rx_packet contains a complete packet.
 void rx_handle_command();
 
+void cmd_handle_none();
 void cmd_handle_attribute_read();
+void cmd_handle_attribute_write();
 void cmd_handle_get_auth_key();
 void cmd_handle_enter_app();
+void cmd_handle_enter_suspend();
+void cmd_handle_reboot();
+
+// The firmware write commands, see fw_update.h.
+void cmd_handle_fw_write_init();
+void cmd_handle_fw_write_packet();
+void cmd_handle_fw_write_validate_crc();
+void cmd_handle_fw_write_validate_image();
+
+// Our own reports, in case the reMarkable sends them back.
+void cmd_handle_report();
 
 void cmd_send_keep_alive();
 void cmd_send_key(key_event_type_t type, uint8_t keycode);
 
+void cmd_print_stats();
+
 #endif
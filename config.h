@@ -0,0 +1,131 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _CONFIG_H
+#define _CONFIG_H
+
+// Build-time switches. All of these can be overridden from CMake (see the
+// options in CMakeLists.txt), the values here are only the defaults.
+
+// Upper bound for the interrupt endpoint polling interval of USB keyboards in
+// milliseconds. Devices that advertise a longer interval get polled at this
+// rate instead. 0 keeps whatever the device advertises.
+#ifndef RMK_USB_POLL_INTERVAL_MS
+#define RMK_USB_POLL_INTERVAL_MS 0
+#endif
+
+// Keep the parsed HID report descriptor layouts (see hid_cache.c) in the last
+// flash sector, so that they survive a power cycle.
+#ifndef RMK_HID_CACHE_FLASH
+#define RMK_HID_CACHE_FLASH 0
+#endif
+
+// Capture the pogo traffic into a RAM ring (see trace.h). Capturing is started
+// and stopped from the debug console.
+#ifndef RMK_TRACE
+#define RMK_TRACE 0
+#endif
+
+// Size of the trace ring in bytes, must be a power of two.
+#ifndef RMK_TRACE_BUFFER_SIZE
+#define RMK_TRACE_BUFFER_SIZE 32768
+#endif
+
+// Run the pogo UART on PIO instead of uart1 (see pogo_uart.pio). The PIO
+// receiver flags frame starts itself, so the CPU isn't bothered with the line
+// while the parser is waiting for one.
+#ifndef RMK_POGO_PIO
+#define RMK_POGO_PIO 0
+#endif
+
+// Accept firmware images from the reMarkable into a staging area in flash
+// (see fw_update.h). Without it, the firmware write commands are answered
+// with an error.
+#ifndef RMK_FW_UPDATE
+#define RMK_FW_UPDATE 0
+#endif
+
+// Timeout of the watchdog the main loop feeds, in milliseconds. 0 disables
+// it. This has to stay below the reMarkable's keep-alive timeout of about a
+// second, so that after a hang we're back before the keyboard is dropped.
+#ifndef RMK_WATCHDOG_MS
+#define RMK_WATCHDOG_MS 500
+#endif
+
+// Run the per-byte and per-key code from SRAM instead of flash (see
+// hot_path.h).
+#ifndef RMK_RAM_HOT_PATH
+#define RMK_RAM_HOT_PATH 0
+#endif
+
+// Count XIP cache hits and misses and cycles on the hot path, shown with the
+// statistics. The cycles are counted with SysTick, so this doesn't go together
+// with RMK_FREERTOS.
+#ifndef RMK_XIP_PROFILE
+#define RMK_XIP_PROFILE 0
+#endif
+
+// Run on FreeRTOS SMP with separate tasks for the pogo line, USB and the
+// debug console instead of the single main loop (see rtos.h).
+#ifndef RMK_FREERTOS
+#define RMK_FREERTOS 0
+#endif
+
+// Tapping term of the dual-role keys in milliseconds (see tap_hold.h). Held
+// for longer, Caps Lock is Ctrl. 0 turns dual-role keys off, Caps Lock is then
+// just Caps Lock.
+#ifndef RMK_TAP_HOLD_MS
+#define RMK_TAP_HOLD_MS 0
+#endif
+
+// Drop clk_sys to 48 MHz after this many milliseconds without a HID report or
+// a byte from the reMarkable (see clock_scaling.h). 0 keeps it at full speed.
+// PIO-USB and the FreeRTOS tick both depend on clk_sys, so this doesn't go
+// together with RMK_PIO_USB_HOST or RMK_FREERTOS.
+#ifndef RMK_IDLE_CLOCK_MS
+#define RMK_IDLE_CLOCK_MS 0
+#endif
+
+// Run the keyboard on a PIO based USB host port (Pico-PIO-USB, D+/D- on GPIO
+// 2/3) and use the native USB controller as a CDC device for the debug
+// console (see cdc_stdio.h). PIO-USB takes state machines on both PIO blocks,
+// so this doesn't go together with RMK_POGO_PIO.
+#ifndef RMK_PIO_USB_HOST
+#define RMK_PIO_USB_HOST 0
+#endif
+
+// Send stdio to a SEGGER RTT style ring in RAM that a debug probe reads over
+// SWD, instead of the debug UART, and publish the statistics in a table the
+// probe can find (see rtt.h).
+#ifndef RMK_RTT
+#define RMK_RTT 0
+#endif
+
+#if RMK_PIO_USB_HOST && RMK_POGO_PIO
+#error RMK_PIO_USB_HOST and RMK_POGO_PIO both need pio0
+#endif
+
+#if RMK_PIO_USB_HOST && RMK_FREERTOS
+#error RMK_PIO_USB_HOST is not supported with RMK_FREERTOS yet
+#endif
+
+#if RMK_XIP_PROFILE && RMK_FREERTOS
+#error RMK_XIP_PROFILE takes over SysTick, which is the FreeRTOS tick
+#endif
+
+#if RMK_IDLE_CLOCK_MS && (RMK_PIO_USB_HOST || RMK_FREERTOS)
+#error RMK_IDLE_CLOCK_MS needs a fixed clk_sys for PIO-USB and the FreeRTOS tick
+#endif
+
+#endif
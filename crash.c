@@ -0,0 +1,191 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/watchdog.h"
+
+#include "config.h"
+#include "crash.h"
+#include "command.h"
+#include "hot_path.h"
+
+#define CRASH_MAGIC 0x43525348 // "CRSH"
+
+typedef struct crash_log {
+  uint32_t magic;
+  uint32_t crashes; // Since power on.
+  uint8_t count;
+  uint8_t next;
+  crash_record_t history[CRASH_HISTORY];
+} crash_log_t;
+
+// Neither of these is touched by the startup code, so they still hold what
+// was there before a watchdog reboot. After power on, they're garbage.
+crash_record_t __uninitialized_ram(crash_current);
+static crash_log_t __uninitialized_ram(crash_log);
+
+static const char *stage_name(uint8_t stage) {
+  switch (stage) {
+    case CRASH_STAGE_CONSOLE: return "console";
+    case CRASH_STAGE_USB_HOST: return "tuh_task";
+    case CRASH_STAGE_USB: return "usb_task";
+    case CRASH_STAGE_POGO_RX: return "pogo rx";
+    case CRASH_STAGE_COMMAND: return "command";
+    case CRASH_STAGE_KEYS: return "keys";
+    case CRASH_STAGE_SUSPEND: return "suspend";
+    default: return "unknown";
+  }
+}
+
+static void print_record(crash_record_t const *record) {
+  if (record->reason == CRASH_HARDFAULT) {
+    printf("Crash: hard fault at pc %08lx lr %08lx", record->pc, record->lr);
+  } else {
+    printf("Crash: watchdog timeout");
+  }
+  printf(" in %s, mode %d, after %lu loops\n", stage_name(record->stage), record->mode,
+    record->loops);
+
+  for (uint8_t i = 0; i < CRASH_PACKETS; i++) {
+    crash_packet_t const *packet = &record->packets[(record->next_packet + i) % CRASH_PACKETS];
+    if (packet->data_length == 0 && packet->command == 0) {
+      continue;
+    }
+    printf("Crash:   %s %s len %d data %02x %02x %02x %02x\n",
+      packet->direction == DIRECTION_TX ? "TX" : "RX", command_name(packet->command),
+      packet->data_length, packet->data[0], packet->data[1], packet->data[2], packet->data[3]);
+  }
+}
+
+bool crash_init() {
+  bool resume = false;
+
+  if (crash_log.magic != CRASH_MAGIC || !watchdog_caused_reboot()) {
+    // Power on, or reset by the debugger.
+    memset(&crash_log, 0, sizeof(crash_log));
+    crash_log.magic = CRASH_MAGIC;
+  } else if (crash_current.reason == CRASH_HARDFAULT || watchdog_enable_caused_reboot()) {
+    if (crash_current.reason == CRASH_NONE) {
+      crash_current.reason = CRASH_WATCHDOG;
+    }
+    print_record(&crash_current);
+
+    crash_log.history[crash_log.next] = crash_current;
+    crash_log.next = (crash_log.next + 1) % CRASH_HISTORY;
+    if (crash_log.count < CRASH_HISTORY) {
+      crash_log.count++;
+    }
+    crash_log.crashes++;
+
+    resume = crash_current.mode == APP_KEYBOARD;
+  }
+
+  memset(&crash_current, 0, sizeof(crash_current));
+  return resume;
+}
+
+void crash_watchdog_start() {
+#if RMK_WATCHDOG_MS
+  watchdog_enable(RMK_WATCHDOG_MS, true);
+#endif
+}
+
+void RMK_HOT(crash_loop)(app_mode_t mode) {
+  crash_current.loops++;
+  crash_current.mode = (uint8_t)mode;
+  crash_current.stage = CRASH_STAGE_CONSOLE;
+#if !RMK_FREERTOS
+  // With RMK_FREERTOS, the housekeeping task feeds it (see rtos.h).
+  crash_watchdog_feed();
+#endif
+}
+
+void RMK_HOT(crash_watchdog_feed)() {
+#if RMK_WATCHDOG_MS
+  watchdog_update();
+#endif
+}
+
+void crash_watchdog_pause() {
+#if RMK_WATCHDOG_MS
+  hw_clear_bits(&watchdog_hw->ctrl, WATCHDOG_CTRL_ENABLE_BITS);
+#endif
+}
+
+void crash_watchdog_resume() {
+  crash_watchdog_start();
+}
+
+void crash_reboot() {
+#if PICO_ON_DEVICE
+  // Unlike watchdog_enable, this doesn't set the magic that
+  // watchdog_enable_caused_reboot looks for.
+  watchdog_reboot(0, 0, 0);
+  while (true) {
+  }
+#endif
+}
+
+void RMK_HOT(crash_record_packet)(packet_direction_t direction, packet_t const *packet) {
+  crash_packet_t *entry = &crash_current.packets[crash_current.next_packet];
+  crash_current.next_packet = (crash_current.next_packet + 1) % CRASH_PACKETS;
+
+  entry->direction = (uint8_t)direction;
+  entry->command = (uint8_t)packet->command;
+  entry->data_length = packet->data_length;
+  for (uint8_t i = 0; i < sizeof(entry->data); i++) {
+    entry->data[i] = i < packet->data_length ? packet->data[i] : 0;
+  }
+}
+
+void crash_print() {
+  printf("Crash: %lu since power on\n", crash_log.crashes);
+  for (uint8_t i = 0; i < crash_log.count; i++) {
+    uint8_t ix = (crash_log.next + CRASH_HISTORY - crash_log.count + i) % CRASH_HISTORY;
+    print_record(&crash_log.history[ix]);
+  }
+}
+
+#if PICO_ON_DEVICE
+// Called from isr_hardfault with the exception stack frame: r0-r3, r12, lr,
+// pc, xpsr.
+void __attribute__((used)) crash_hardfault(uint32_t const *frame) {
+  crash_current.reason = CRASH_HARDFAULT;
+  crash_current.lr = frame[5];
+  crash_current.pc = frame[6];
+  watchdog_reboot(0, 0, 0);
+  while (true) {
+  }
+}
+
+// Replaces the SDK's handler, which just halts. The frame is on whichever
+// stack was in use when the fault hit.
+void __attribute__((naked)) isr_hardfault() {
+  __asm volatile(
+    "movs r0, #4\n"
+    "mov r1, lr\n"
+    "tst r0, r1\n"
+    "beq 1f\n"
+    "mrs r0, psp\n"
+    "b 2f\n"
+    "1:\n"
+    "mrs r0, msp\n"
+    "2:\n"
+    "ldr r1, =crash_hardfault\n"
+    "bx r1\n"
+    ".ltorg\n");
+}
+#endif
@@ -0,0 +1,101 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _CRASH_H
+#define _CRASH_H
+
+#include "pico/stdlib.h"
+#include "app.h"
+#include "packet.h"
+
+// The main loop feeds a hardware watchdog. What the loop was doing is kept in
+// RAM that survives a reboot, so after a hang or a hard fault we can tell
+// what happened and, if we were in keyboard mode, carry on without a new
+// handshake.
+
+#define CRASH_PACKETS 8 // Last packets kept per crash.
+#define CRASH_HISTORY 4 // Crashes kept across reboots.
+
+// Where in the main loop we are.
+typedef enum crash_stage {
+  CRASH_STAGE_CONSOLE = 0,
+  CRASH_STAGE_USB_HOST,
+  CRASH_STAGE_USB,
+  CRASH_STAGE_POGO_RX,
+  CRASH_STAGE_COMMAND,
+  CRASH_STAGE_KEYS,
+  CRASH_STAGE_SUSPEND
+} crash_stage_t;
+
+typedef enum crash_reason {
+  CRASH_NONE = 0,
+  CRASH_WATCHDOG = 1,
+  CRASH_HARDFAULT = 2
+} crash_reason_t;
+
+typedef struct crash_packet {
+  uint8_t direction;
+  uint8_t command;
+  uint16_t data_length;
+  uint8_t data[4]; // Just the start.
+} crash_packet_t;
+
+typedef struct crash_record {
+  uint8_t reason;
+  uint8_t stage;
+  uint8_t mode;
+  uint8_t next_packet;
+  uint32_t loops;
+  uint32_t pc; // Only for hard faults.
+  uint32_t lr;
+  crash_packet_t packets[CRASH_PACKETS];
+} crash_record_t;
+
+// Looks at the record from before the reboot and reports it. Returns true if
+// we crashed in keyboard mode and should go straight back to it.
+bool crash_init();
+
+// Starts the watchdog with a timeout of RMK_WATCHDOG_MS.
+void crash_watchdog_start();
+
+// Call once per main loop iteration. This feeds the watchdog, except with
+// RMK_FREERTOS, where it's called by the pogo task and the stage is whatever
+// the pogo or the usb task set last.
+void crash_loop(app_mode_t mode);
+
+extern crash_record_t crash_current;
+
+// Marks where in the main loop we are. This is on the hot path, so it's just
+// a store.
+static inline void crash_stage(crash_stage_t stage) {
+  crash_current.stage = stage;
+}
+
+// Feeds the watchdog from something that takes long on purpose, like dumping
+// the trace.
+void crash_watchdog_feed();
+
+// The watchdog is stopped while we're suspended.
+void crash_watchdog_pause();
+void crash_watchdog_resume();
+
+// Reboots on purpose, which crash_init doesn't count as a crash. Only returns
+// in the simulator.
+void crash_reboot();
+
+void crash_record_packet(packet_direction_t direction, packet_t const *packet);
+
+void crash_print();
+
+#endif
@@ -0,0 +1,221 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+
+#include "config.h"
+#include "fw_update.h"
+
+#if RMK_FW_UPDATE
+#include "hardware/dma.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#if RMK_FREERTOS
+#include "pico/flash.h"
+#endif
+
+// Data is collected in here until there's a full flash page to program. The
+// DMA channel that copies it in from the packet also feeds the sniffer, so the
+// CRC is up to date with every packet and validating doesn't have to read the
+// image back.
+typedef struct fw_transfer {
+  bool active;
+  bool crc_ok;
+  uint32_t size;
+  uint32_t received;
+  uint32_t written; // Bytes programmed into flash, always whole pages.
+  uint32_t crc; // Raw sniffer accumulator, see fw_crc().
+  uint16_t page_fill;
+  uint8_t page[FLASH_PAGE_SIZE];
+} fw_transfer_t;
+
+static fw_transfer_t fw;
+static int fw_dma_chan = -1;
+
+// Longest time spent in fw_write_packet, including erasing and programming.
+static uint32_t max_packet_us = 0;
+static uint32_t last_validate_us = 0;
+
+static inline uint32_t read_uint32(uint8_t const *data) {
+  return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+// The sniffer runs the reflected CRC-32 on bit reversed data, but doesn't
+// reflect the result or apply the final XOR. We keep the accumulator raw so it
+// can be written back before the next copy and finish it here.
+static uint32_t fw_crc() {
+  uint32_t value = fw.crc, reflected = 0;
+  for (int i = 0; i < 32; i++) {
+    reflected = (reflected << 1) | (value & 1);
+    value >>= 1;
+  }
+  return ~reflected;
+}
+
+static void copy_with_crc(uint8_t *dst, uint8_t const *src, uint16_t len) {
+  if (fw_dma_chan < 0) {
+    fw_dma_chan = dma_claim_unused_channel(true);
+  }
+
+  dma_channel_config c = dma_channel_get_default_config(fw_dma_chan);
+  channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+  channel_config_set_read_increment(&c, true);
+  channel_config_set_write_increment(&c, true);
+  channel_config_set_sniff_enable(&c, true);
+
+  dma_sniffer_enable(fw_dma_chan, DMA_SNIFF_CTRL_CALC_VALUE_CRC32R, true);
+  dma_hw->sniff_data = fw.crc;
+  dma_channel_configure(fw_dma_chan, &c, dst, src, len, true);
+  dma_channel_wait_for_finish_blocking(fw_dma_chan);
+  fw.crc = dma_hw->sniff_data;
+  dma_sniffer_disable();
+}
+
+// The reMarkable waits for our answer to every packet, so nothing arrives on
+// the pogo line while interrupts are off here.
+static void write_flash(void *unused) {
+  if (fw.written % FLASH_SECTOR_SIZE == 0) {
+    flash_range_erase(FW_STAGING_OFFSET + fw.written, FLASH_SECTOR_SIZE);
+  }
+  flash_range_program(FW_STAGING_OFFSET + fw.written, fw.page, FLASH_PAGE_SIZE);
+}
+
+static void program_page() {
+  memset(fw.page + fw.page_fill, 0xff, FLASH_PAGE_SIZE - fw.page_fill);
+
+#if RMK_FREERTOS
+  // The other core runs from flash as well, it's parked while we write.
+  flash_safe_execute(write_flash, NULL, UINT32_MAX);
+#else
+  uint32_t interrupts = save_and_disable_interrupts();
+  write_flash(NULL);
+  restore_interrupts(interrupts);
+#endif
+
+  fw.written += FLASH_PAGE_SIZE;
+  fw.page_fill = 0;
+}
+#endif
+
+fw_status_t fw_write_init(uint8_t const *data, uint16_t len) {
+#if RMK_FW_UPDATE
+  if (len < 4) {
+    return FW_ERROR_LENGTH;
+  }
+
+  uint32_t size = read_uint32(data);
+  if (size == 0 || size > FW_STAGING_SIZE) {
+    return FW_ERROR_LENGTH;
+  }
+
+  memset(&fw, 0, sizeof(fw));
+  fw.active = true;
+  fw.size = size;
+  fw.crc = 0xffffffff;
+
+  printf("FW: Receiving %lu byte image\n", size);
+  return FW_OK;
+#else
+  return FW_ERROR_UNSUPPORTED;
+#endif
+}
+
+fw_status_t fw_write_packet(uint8_t const *data, uint16_t len) {
+#if RMK_FW_UPDATE
+  if (!fw.active) {
+    return FW_ERROR_STATE;
+  }
+  if (len < 4) {
+    return FW_ERROR_LENGTH;
+  }
+  if (read_uint32(data) != fw.received) {
+    return FW_ERROR_OFFSET;
+  }
+
+  data += 4;
+  len -= 4;
+  if (len > fw.size - fw.received) {
+    return FW_ERROR_LENGTH;
+  }
+
+  absolute_time_t start = get_absolute_time();
+  while (len > 0) {
+    uint16_t chunk = MIN(len, FLASH_PAGE_SIZE - fw.page_fill);
+    copy_with_crc(fw.page + fw.page_fill, data, chunk);
+    fw.page_fill += chunk;
+    fw.received += chunk;
+    data += chunk;
+    len -= chunk;
+
+    if (fw.page_fill == FLASH_PAGE_SIZE || fw.received == fw.size) {
+      program_page();
+    }
+  }
+
+  uint32_t took = (uint32_t)absolute_time_diff_us(start, get_absolute_time());
+  if (took > max_packet_us) {
+    max_packet_us = took;
+  }
+  return FW_OK;
+#else
+  return FW_ERROR_UNSUPPORTED;
+#endif
+}
+
+fw_status_t fw_write_validate_crc(uint8_t const *data, uint16_t len) {
+#if RMK_FW_UPDATE
+  if (!fw.active || fw.received != fw.size) {
+    return FW_ERROR_STATE;
+  }
+  if (len < 4) {
+    return FW_ERROR_LENGTH;
+  }
+
+  absolute_time_t start = get_absolute_time();
+  uint32_t crc = fw_crc();
+  fw.crc_ok = crc == read_uint32(data);
+  last_validate_us = (uint32_t)absolute_time_diff_us(start, get_absolute_time());
+
+  printf("FW: CRC %08lx, expected %08lx\n", crc, read_uint32(data));
+  return fw.crc_ok ? FW_OK : FW_ERROR_CRC;
+#else
+  return FW_ERROR_UNSUPPORTED;
+#endif
+}
+
+fw_status_t fw_write_validate_image() {
+#if RMK_FW_UPDATE
+  if (!fw.active || fw.received != fw.size) {
+    return FW_ERROR_STATE;
+  }
+  if (!fw.crc_ok) {
+    return FW_ERROR_CRC;
+  }
+
+  fw.active = false;
+  printf("FW: Image of %lu bytes staged at flash offset %x\n", fw.size, FW_STAGING_OFFSET);
+  return FW_OK;
+#else
+  return FW_ERROR_UNSUPPORTED;
+#endif
+}
+
+void fw_print_stats() {
+#if RMK_FW_UPDATE
+  printf("FW: %lu of %lu bytes received, %lu written, slowest packet %lu us, CRC check %lu us\n",
+    fw.received, fw.size, fw.written, max_packet_us, last_validate_us);
+#endif
+}
@@ -0,0 +1,53 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _FW_UPDATE_H
+#define _FW_UPDATE_H
+
+#include "pico/stdlib.h"
+
+// Receives a firmware image from the reMarkable into a staging area in flash.
+// The kernel driver doesn't tell us much about the payloads, so this assumes:
+//
+//   CMD_FW_WRITE_INIT:           uint32 image size
+//   CMD_FW_WRITE_PACKET:         uint32 offset, followed by the image data
+//   CMD_FW_WRITE_VALIDATE_CRC:   uint32 CRC-32 (as in zlib) of the image
+//   CMD_FW_WRITE_VALIDATE_IMAGE: no data
+//
+// All numbers are little endian. Packets have to come in order. Every
+// command is answered with the same command and a single fw_status_t byte.
+//
+// The image is only staged, nothing ever boots it.
+
+// Staging area in flash, behind the adapter's own firmware.
+#define FW_STAGING_OFFSET 0x100000
+#define FW_STAGING_SIZE 0x80000
+
+typedef enum fw_status {
+  FW_OK = 0,
+  FW_ERROR_UNSUPPORTED = 1, // Built without RMK_FW_UPDATE.
+  FW_ERROR_STATE = 2, // No transfer going on, or it isn't finished yet.
+  FW_ERROR_LENGTH = 3,
+  FW_ERROR_OFFSET = 4, // Packet out of order.
+  FW_ERROR_CRC = 5
+} fw_status_t;
+
+fw_status_t fw_write_init(uint8_t const *data, uint16_t len);
+fw_status_t fw_write_packet(uint8_t const *data, uint16_t len);
+fw_status_t fw_write_validate_crc(uint8_t const *data, uint16_t len);
+fw_status_t fw_write_validate_image();
+
+void fw_print_stats();
+
+#endif
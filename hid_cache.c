@@ -0,0 +1,116 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+
+#include "config.h"
+#include "hid_cache.h"
+
+#if RMK_HID_CACHE_FLASH
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#if RMK_FREERTOS
+#include "pico/flash.h"
+#endif
+
+// The cache lives in the very last sector of the flash.
+#define HID_CACHE_FLASH_OFFSET (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE)
+#define HID_CACHE_MAGIC 0x48494443 // "HIDC"
+#endif
+
+typedef struct hid_cache {
+  uint32_t magic;
+  uint8_t count;
+  uint8_t next; // Slot that gets evicted next once the cache is full.
+  hid_cache_entry_t entries[HID_CACHE_ENTRIES];
+} hid_cache_t;
+
+#if RMK_HID_CACHE_FLASH
+// flash_range_program wants whole pages.
+#define HID_CACHE_FLASH_SIZE ((sizeof(hid_cache_t) + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE * FLASH_PAGE_SIZE)
+#endif
+
+static hid_cache_t cache;
+static bool cache_dirty = false;
+
+void hid_cache_init() {
+  memset(&cache, 0, sizeof(cache));
+
+#if RMK_HID_CACHE_FLASH
+  hid_cache_t const *stored = (hid_cache_t const *)(XIP_BASE + HID_CACHE_FLASH_OFFSET);
+  if (stored->magic == HID_CACHE_MAGIC && stored->count <= HID_CACHE_ENTRIES) {
+    cache = *stored;
+    printf("USB: Loaded %d cached report descriptor layouts\n", cache.count);
+  }
+#endif
+}
+
+hid_cache_entry_t const *hid_cache_lookup(uint16_t vid, uint16_t pid, uint8_t instance, uint16_t desc_len) {
+  for (uint8_t i = 0; i < cache.count; i++) {
+    hid_cache_entry_t const *entry = &cache.entries[i];
+    if (entry->vid == vid && entry->pid == pid &&
+        entry->instance == instance && entry->desc_len == desc_len) {
+      return entry;
+    }
+  }
+
+  return NULL;
+}
+
+void hid_cache_store(hid_cache_entry_t const *entry) {
+  uint8_t slot;
+  if (cache.count < HID_CACHE_ENTRIES) {
+    slot = cache.count++;
+  } else {
+    slot = cache.next;
+    cache.next = (cache.next + 1) % HID_CACHE_ENTRIES;
+  }
+
+  cache.entries[slot] = *entry;
+  cache_dirty = true;
+}
+
+#if RMK_HID_CACHE_FLASH
+static void write_flash(void *page_buffer) {
+  flash_range_erase(HID_CACHE_FLASH_OFFSET, FLASH_SECTOR_SIZE);
+  flash_range_program(HID_CACHE_FLASH_OFFSET, page_buffer, HID_CACHE_FLASH_SIZE);
+}
+#endif
+
+void hid_cache_flush() {
+  if (!cache_dirty) {
+    return;
+  }
+  cache_dirty = false;
+
+#if RMK_HID_CACHE_FLASH
+  static uint8_t page_buffer[HID_CACHE_FLASH_SIZE];
+  memset(page_buffer, 0xff, sizeof(page_buffer));
+  cache.magic = HID_CACHE_MAGIC;
+  memcpy(page_buffer, &cache, sizeof(cache));
+
+#if RMK_FREERTOS
+  // The other core runs from flash as well, it's parked while we write.
+  flash_safe_execute(write_flash, page_buffer, UINT32_MAX);
+#else
+  uint32_t interrupts = save_and_disable_interrupts();
+  write_flash(page_buffer);
+  restore_interrupts(interrupts);
+#endif
+
+  printf("USB: Stored %d report descriptor layouts in flash\n", cache.count);
+#endif
+}
@@ -0,0 +1,54 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _HID_CACHE_H
+#define _HID_CACHE_H
+
+#include "tusb_config.h"
+#include "tusb.h"
+
+// Maximum number of reports we keep per HID instance. The same limit is used
+// for parsing in usb_keyboard.c.
+#define MAX_REPORT 4
+
+#define HID_CACHE_ENTRIES 8
+
+// The parsed report layout of one HID interface of one keyboard model. We
+// identify the interface by VID/PID, instance number and the length of the
+// report descriptor.
+typedef struct hid_cache_entry {
+  uint16_t vid;
+  uint16_t pid;
+  uint8_t instance;
+  uint8_t report_count;
+  uint16_t desc_len;
+  tuh_hid_report_info_t report_info[MAX_REPORT];
+} hid_cache_entry_t;
+
+// Loads the persisted entries from flash, if RMK_HID_CACHE_FLASH is enabled.
+void hid_cache_init();
+
+// Returns NULL on a cache miss.
+hid_cache_entry_t const *hid_cache_lookup(uint16_t vid, uint16_t pid, uint8_t instance, uint16_t desc_len);
+
+// Adds an entry, evicting the oldest one if the cache is full.
+void hid_cache_store(hid_cache_entry_t const *entry);
+
+// Writes the cache to flash if it changed since the last call. This blocks
+// interrupts for a few dozen milliseconds, long enough for the pogo UART's
+// FIFO to overflow, so it's only called while the reMarkable is asleep or
+// gone (see app.c).
+void hid_cache_flush();
+
+#endif
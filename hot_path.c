@@ -0,0 +1,51 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+
+#include "hot_path.h"
+
+#if RMK_XIP_PROFILE
+
+xip_profile_t xip_profiles[XIP_PROBES];
+
+static const char *probe_names[XIP_PROBES] = {
+  "RX byte",
+  "HID report",
+  "Key event"
+};
+
+void xip_profile_init() {
+  memset(xip_profiles, 0, sizeof(xip_profiles));
+
+  // SysTick counts down from 2^24 - 1 at clk_sys, that's 134 ms at 125 MHz.
+  systick_hw->rvr = 0xffffff;
+  systick_hw->cvr = 0;
+  systick_hw->csr = M0PLUS_SYST_CSR_CLKSOURCE_BITS | M0PLUS_SYST_CSR_ENABLE_BITS;
+}
+
+void xip_profile_print() {
+  printf("XIP: hot path in %s\n", RMK_RAM_HOT_PATH ? "SRAM" : "flash");
+  for (int i = 0; i < XIP_PROBES; i++) {
+    xip_profile_t const *profile = &xip_profiles[i];
+    uint32_t avg_misses = profile->runs ? (uint32_t)(profile->misses / profile->runs) : 0;
+    printf("XIP: %s: %lu runs, %llu accesses, %llu misses (%lu per run, max %lu), max %lu cycles\n",
+      probe_names[i], profile->runs, profile->accesses, profile->misses, avg_misses,
+      profile->max_misses, profile->max_cycles);
+  }
+}
+
+#endif
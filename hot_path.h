@@ -0,0 +1,103 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _HOT_PATH_H
+#define _HOT_PATH_H
+
+#include "pico/stdlib.h"
+#include "config.h"
+
+#if RMK_XIP_PROFILE
+#include "hardware/structs/systick.h"
+#include "hardware/structs/xip_ctrl.h"
+#endif
+
+// Everything that runs for every received byte and every key event is marked
+// with RMK_HOT. With RMK_RAM_HOT_PATH, it's copied to SRAM at boot instead of
+// running from flash, where an XIP cache miss stalls for a QSPI read.
+//
+//   rx_result_t RMK_HOT(rx_process_byte)(uint8_t data) { ... }
+#if RMK_RAM_HOT_PATH
+#define RMK_HOT(name) __not_in_flash_func(name)
+#else
+#define RMK_HOT(name) name
+#endif
+
+// Same for the lookup tables the hot path reads, which otherwise sit in
+// .rodata in flash.
+#if RMK_RAM_HOT_PATH
+#define RMK_HOT_DATA(name) __not_in_flash("rmk_tables") name
+#else
+#define RMK_HOT_DATA(name) name
+#endif
+
+// With RMK_XIP_PROFILE, the XIP cache counters and the cycle count are taken
+// around each of these.
+typedef enum xip_probe {
+  XIP_PROBE_RX_BYTE = 0,
+  XIP_PROBE_HID_REPORT,
+  XIP_PROBE_KEY_EVENT,
+  XIP_PROBES
+} xip_probe_t;
+
+typedef struct xip_profile {
+  uint32_t runs;
+  uint64_t accesses;
+  uint64_t misses;
+  uint32_t max_misses;
+  uint32_t max_cycles;
+} xip_profile_t;
+
+#if RMK_XIP_PROFILE
+
+extern xip_profile_t xip_profiles[XIP_PROBES];
+
+// The hardware counters saturate, so they're cleared at the start of every
+// measurement. Measurements must not nest.
+static inline void xip_profile_begin() {
+  xip_ctrl_hw->ctr_hit = 0;
+  xip_ctrl_hw->ctr_acc = 0;
+  systick_hw->cvr = 0;
+}
+
+static inline void xip_profile_end(xip_probe_t probe) {
+  uint32_t cycles = 0xffffff - systick_hw->cvr;
+  uint32_t accesses = xip_ctrl_hw->ctr_acc;
+  uint32_t misses = accesses - xip_ctrl_hw->ctr_hit;
+
+  xip_profile_t *profile = &xip_profiles[probe];
+  profile->runs++;
+  profile->accesses += accesses;
+  profile->misses += misses;
+  if (misses > profile->max_misses) {
+    profile->max_misses = misses;
+  }
+  if (cycles > profile->max_cycles) {
+    profile->max_cycles = cycles;
+  }
+}
+
+void xip_profile_init();
+void xip_profile_print();
+
+#else
+
+static inline void xip_profile_begin() {}
+static inline void xip_profile_end(xip_probe_t probe) {}
+static inline void xip_profile_init() {}
+static inline void xip_profile_print() {}
+
+#endif
+
+#endif
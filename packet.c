@@ -16,52 +16,48 @@
 #include <string.h>
 #include "pico/stdlib.h"
 #include "packet.h"
+#include "command.h"
+#include "pogo_uart.h"
+#include "crash.h"
+#include "trace.h"
+#include "hot_path.h"
 
 // Global variables for rx_process_byte.
 uint16_t data_counter = 0;
 rx_state_t rx_state;
-uint8_t tx_buffer[TX_BUFFER_LEN];
+static uint8_t rx_sum;
 
 packet_t rx_packet;
 packet_t tx_packet;
 
-static char *cmd_str_none = "CMD_NONE";
-static char *cmd_str_fw_write_validate_image = "CMD_FW_WRITE_VALIDATE_IMAGE";
-static char *cmd_str_enter_app = "CMD_ENTER_APP";
-static char *cmd_str_enter_suspend = "CMD_ENTER_SUSPEND";
-static char *cmd_str_fw_write_validate_crc = "CMD_FW_WRITE_VALIDATE_CRC";
-static char *cmd_str_fw_write_packet = "CMD_FW_WRITE_PACKET";
-static char *cmd_str_fw_write_init = "CMD_FW_WRITE_INIT";
-static char *cmd_str_get_auth_key = "CMD_GET_AUTH_KEY";
-static char *cmd_str_reboot = "CMD_REBOOT";
-static char *cmd_str_attribute_read = "CMD_ATTRIBUTE_READ";
-static char *cmd_str_attribute_write = "CMD_ATTRIBUTE_WRITE";
-static char *cmd_str_report_alive = "CMD_REPORT_ALIVE";
-static char *cmd_str_report_key = "CMD_REPORT_KEY";
-static char *cmd_str_unknown = "UNKNOWN";
-
-char *command_name(command_t command) {
-  switch (command) {
-    case CMD_NONE: return cmd_str_none;
-    case CMD_FW_WRITE_VALIDATE_IMAGE: return cmd_str_fw_write_validate_image;
-    case CMD_ENTER_APP: return cmd_str_enter_app;
-    case CMD_ENTER_SUSPEND: return cmd_str_enter_suspend;
-    case CMD_FW_WRITE_VALIDATE_CRC: return cmd_str_fw_write_validate_crc;
-    case CMD_FW_WRITE_PACKET: return cmd_str_fw_write_packet;
-    case CMD_FW_WRITE_INIT: return cmd_str_fw_write_init;
-    case CMD_GET_AUTH_KEY: return cmd_str_get_auth_key;
-    case CMD_REBOOT: return cmd_str_reboot;
-    case CMD_ATTRIBUTE_READ: return cmd_str_attribute_read;
-    case CMD_ATTRIBUTE_WRITE: return cmd_str_attribute_write;
-    case CMD_REPORT_ALIVE: return cmd_str_report_alive;
-    case CMD_REPORT_KEY: return cmd_str_report_key;
-
-    default:
-      return cmd_str_unknown;
-  }
-}
+tx_stats_t tx_stats;
+
+bool packet_log = !(RMK_RAM_HOT_PATH || RMK_XIP_PROFILE);
+
+// Frames collected between tx_batch_begin and tx_batch_flush.
+static uint8_t tx_batch[TX_BATCH_LEN];
+static uint16_t tx_batch_len = 0;
+static uint8_t tx_batch_frames = 0;
+static bool tx_batching = false;
+
+rx_stats_t rx_stats;
+
+// Bytes of the frame that's currently being received, starting with its 0x3a.
+// If the frame turns out to be bad, we look for another frame start in here.
+static uint8_t rx_history[RX_HISTORY_LEN];
+static uint16_t rx_history_len = 0;
 
-void print_packet(packet_t *packet, packet_direction_t direction) {
+// Bytes that still need to be parsed again after a bad frame. While these are
+// being parsed, nothing new is read, so a bad frame found in here is made up of
+// bytes from this buffer and the buffer only ever shrinks.
+static uint8_t rx_resync_buffer[RX_HISTORY_LEN];
+static uint16_t rx_resync_len = 0, rx_resync_pos = 0;
+
+static bool rx_frame_from_resync = false;
+static bool rx_resyncing = false;
+static uint64_t rx_resync_start_us;
+
+void print_packet(packet_t const *packet, packet_direction_t direction) {
   char prefix = ' ';
   if (direction == DIRECTION_TX) {
     printf(">>>> TX PACKET\n");
@@ -77,7 +73,7 @@ void print_packet(packet_t *packet, packet_direction_t direction) {
     printf("%x ", packet->data[i]);
   }
   printf("\n");
-  printf("%c Checksum: %d\n", prefix, packet->checksum);
+  printf("%c Checksum: %d\n", prefix, packet_checksum(packet));
   if (direction == DIRECTION_TX) {
     printf(">>>> END TX\n");
   } else {
@@ -85,46 +81,87 @@ void print_packet(packet_t *packet, packet_direction_t direction) {
   }
 }
 
-
 void rx_switch_to_init_state() {
   rx_state = RX_INIT;
+  rx_resync_len = rx_resync_pos = 0;
+}
+
+// The current frame turned out to be bad. Any valid frame that started inside
+// of it is still in rx_history, so we queue everything after the bad frame's
+// start byte up to be parsed again, followed by what was still queued from an
+// earlier resync.
+static void RMK_HOT(rx_start_resync)() {
+  uint16_t remaining = rx_resync_len - rx_resync_pos;
+  memmove(rx_resync_buffer + rx_history_len - 1, rx_resync_buffer + rx_resync_pos, remaining);
+  memcpy(rx_resync_buffer, rx_history + 1, rx_history_len - 1);
+  rx_resync_len = rx_history_len - 1 + remaining;
+  rx_resync_pos = 0;
+
+  if (!rx_resyncing) {
+    rx_resyncing = true;
+    rx_resync_start_us = time_us_64();
+    rx_stats.resyncs++;
+  }
+
+  rx_state = RX_INIT;
 }
 
-rx_result_t rx_process_byte(uint8_t data) {
+static rx_result_t RMK_HOT(rx_step)(uint8_t data, bool from_resync) {
+  if (rx_state > RX_KEY) {
+    rx_history[rx_history_len++] = data;
+  }
+
   switch (rx_state) {
     case RX_INIT:
       // Received our first data, reinitialize the current package and switch
       // to key state.
-      memset(rx_packet.data, 0, MAX_PACKET_DATA);
+      memset(rx_packet.data, 0, sizeof(rx_packet.data));
       rx_packet.command = 0;
       rx_packet.data_length = 0;
-      rx_packet.checksum = 0;
+      rx_sum = 0;
 
       // Deliberate fall through.
       rx_state = RX_KEY;
 
     case RX_KEY:
       if (data == 0x3a) { // Next byte after 0x3a will be the low byte of length.
+        rx_packet.start = data;
+        rx_history[0] = data;
+        rx_history_len = 1;
+        rx_frame_from_resync = from_resync;
         rx_state = RX_LEN_LOW;
+      } else if (!from_resync) {
+        rx_stats.bytes_skipped++;
       }
       return RX_PACKET_RECEIVING;
 
     case RX_LEN_LOW:
       rx_packet.data_length += ((uint16_t)data << 0);
-      rx_packet.checksum += data;
+      rx_sum += data;
       rx_state = RX_LEN_HIGH;
       return RX_PACKET_RECEIVING;
     
     case RX_LEN_HIGH:
       rx_packet.data_length += ((uint16_t)data << 8);
-      rx_packet.checksum += data;
-      // TODO: In theory, the data length can be greater than MAX_PACKET_DATA.
+      rx_sum += data;
+      if (rx_packet.data_length > MAX_PACKET_DATA) {
+        rx_stats.invalid_frames++;
+        rx_start_resync();
+        return RX_PACKET_INVALID_FRAME;
+      }
       rx_state = RX_CMD;
       return RX_PACKET_RECEIVING;
 
     case RX_CMD:
       rx_packet.command = data;
-      rx_packet.checksum += data;
+      rx_sum += data;
+      // Only commands from command_t can start a frame. Anything else means
+      // that we took a random 0x3a for the start of a frame.
+      if (!cmd_is_known(data)) {
+        rx_stats.invalid_frames++;
+        rx_start_resync();
+        return RX_PACKET_INVALID_FRAME;
+      }
       if (rx_packet.data_length > 0) {
         data_counter = 0;
         rx_state = RX_DATA;
@@ -134,7 +171,7 @@ rx_result_t rx_process_byte(uint8_t data) {
       return RX_PACKET_RECEIVING;
 
     case RX_DATA:
-      rx_packet.checksum += data;
+      rx_sum += data;
       rx_packet.data[data_counter] = data;
       if (++data_counter >= rx_packet.data_length) {
         rx_state = RX_CHECKSUM;
@@ -142,15 +179,30 @@ rx_result_t rx_process_byte(uint8_t data) {
       return RX_PACKET_RECEIVING;
 
     case RX_CHECKSUM:
-      rx_packet.checksum ^= 0xff;
-      rx_packet.checksum++;
+      rx_sum ^= 0xff;
+      rx_sum++;
+      rx_packet.data[rx_packet.data_length] = data;
 
       rx_state = RX_INIT;
 
-      if (rx_packet.checksum == data) {
+      if (rx_sum == data) {
+        rx_stats.frames_received++;
+        if (rx_frame_from_resync) {
+          rx_stats.frames_salvaged++;
+        }
+        if (rx_resyncing) {
+          rx_resyncing = false;
+          uint32_t recovery = (uint32_t)(time_us_64() - rx_resync_start_us);
+          rx_stats.last_recovery_us = recovery;
+          if (recovery > rx_stats.max_recovery_us) {
+            rx_stats.max_recovery_us = recovery;
+          }
+        }
         return RX_PACKET_RECEIVED;
       } else {
-        printf("Checksum %x vs %x\n", rx_packet.checksum, data);
+        printf("Checksum %x vs %x\n", rx_sum, data);
+        rx_stats.checksum_errors++;
+        rx_start_resync();
         return RX_PACKET_INVALID_CHECKSUM;
       }
   }
@@ -158,28 +210,107 @@ rx_result_t rx_process_byte(uint8_t data) {
   return RX_PACKET_RECEIVING;
 }
 
+rx_result_t RMK_HOT(rx_process_byte)(uint8_t data) {
+  return rx_step(data, false);
+}
+
+bool RMK_HOT(rx_resync_pending)() {
+  return rx_resync_pos < rx_resync_len;
+}
+
+bool RMK_HOT(rx_is_hunting)() {
+  return rx_state <= RX_KEY && !rx_resync_pending();
+}
+
+rx_result_t RMK_HOT(rx_process_pending)() {
+  if (!rx_resync_pending()) {
+    return RX_PACKET_RECEIVING;
+  }
+  return rx_step(rx_resync_buffer[rx_resync_pos++], true);
+}
+
+void rx_print_stats() {
+  printf("RX: %lu frames, %lu checksum errors, %lu invalid headers, %lu bytes skipped\n",
+    rx_stats.frames_received, rx_stats.checksum_errors, rx_stats.invalid_frames,
+    rx_stats.bytes_skipped);
+  printf("RX: %lu resyncs, %lu frames salvaged, recovery last %lu us max %lu us\n",
+    rx_stats.resyncs, rx_stats.frames_salvaged, rx_stats.last_recovery_us,
+    rx_stats.max_recovery_us);
+}
+
+static void RMK_HOT(tx_write)(uint8_t const *data, uint16_t len) {
+  pogo_uart_write_blocking(data, len);
+  tx_stats.writes++;
+  tx_stats.bytes += len;
+
+  // Trace records hold at most 255 bytes.
+  for (uint16_t offset = 0; offset < len; offset += 255) {
+    trace_record(TRACE_POGO_TX, data + offset, MIN(len - offset, 255));
+  }
+}
+
+static void RMK_HOT(tx_batch_write)() {
+  if (tx_batch_len == 0) {
+    return;
+  }
+
+  tx_write(tx_batch, tx_batch_len);
+  if (tx_batch_frames > tx_stats.max_batch_frames) {
+    tx_stats.max_batch_frames = tx_batch_frames;
+  }
+  tx_batch_len = 0;
+  tx_batch_frames = 0;
+}
+
+void RMK_HOT(tx_batch_begin)() {
+  tx_batching = true;
+}
+
+void RMK_HOT(tx_batch_flush)() {
+  tx_batch_write();
+  tx_batching = false;
+}
 
-void tx_write_packet() {
-  int i = 0;
-  tx_buffer[0] = 0x2e;
-  tx_buffer[1] = (tx_packet.data_length >> 0) & 0xff;
-  tx_buffer[2] = (tx_packet.data_length >> 8) & 0xff;
-  tx_buffer[3] = tx_packet.command;
+void RMK_HOT(tx_write_packet)() {
+  uint8_t checksum = (tx_packet.data_length & 0xff) + (tx_packet.data_length >> 8) + tx_packet.command;
+  for (uint16_t i = 0; i < tx_packet.data_length; i++) {
+    checksum += tx_packet.data[i];
+  }
 
-  tx_packet.checksum = tx_buffer[1] + tx_buffer[2] + tx_buffer[3];
+  tx_packet.start = 0x2e;
+  tx_packet.data[tx_packet.data_length] = (checksum ^ 0xff) + 1;
 
-  for (i = 0; i < tx_packet.data_length; i++) {
-    tx_buffer[4 + i] = tx_packet.data[i];
-    tx_packet.checksum += tx_packet.data[i];
+  if (packet_log) {
+    printf("Sending packet\n");
+    print_packet(&tx_packet, DIRECTION_TX);
   }
 
-  tx_packet.checksum ^= 0xff;
-  tx_packet.checksum++;
-  tx_buffer[4 + i] = tx_packet.checksum;
+  uint8_t const *frame = (uint8_t const *)&tx_packet;
+  uint16_t frame_len = packet_frame_len(&tx_packet);
+  crash_record_packet(DIRECTION_TX, &tx_packet);
+  tx_stats.frames++;
+
+  if (!tx_batching) {
+    tx_write(frame, frame_len);
+    return;
+  }
 
-  printf("Sending packet\n");
-  print_packet(&tx_packet, DIRECTION_TX);
+  if (frame_len > TX_BATCH_LEN) {
+    // Too big for the batch, but it must not overtake what's already in it.
+    tx_batch_write();
+    tx_write(frame, frame_len);
+    return;
+  }
 
-  uart_write_blocking(uart1, tx_buffer, 5 + tx_packet.data_length);
+  if (tx_batch_len + frame_len > TX_BATCH_LEN) {
+    tx_batch_write();
+  }
+  memcpy(tx_batch + tx_batch_len, frame, frame_len);
+  tx_batch_len += frame_len;
+  tx_batch_frames++;
 }
 
+void tx_print_stats() {
+  printf("TX: %lu frames, %lu bytes in %lu writes, up to %d frames per write\n",
+    tx_stats.frames, tx_stats.bytes, tx_stats.writes, tx_stats.max_batch_frames);
+}
@@ -15,11 +15,19 @@
 #ifndef _PACKET_H
 #define _PACKET_H
 
+#include <assert.h>
 #include "pico/stdlib.h"
 
-#define TX_BUFFER_LEN 136
 #define MAX_PACKET_DATA 128
 
+// Start byte, two length bytes, command, data and checksum.
+#define PACKET_OVERHEAD 5
+#define RX_HISTORY_LEN (MAX_PACKET_DATA + PACKET_OVERHEAD)
+
+// Room for a burst of key frames (7 bytes each) in one batch, see
+// tx_batch_begin.
+#define TX_BATCH_LEN 128
+
 // From linux/drivers/misc/rm-pogo/pogo.h
 typedef enum _command {
   CMD_NONE = 0x00,
@@ -40,13 +48,25 @@ typedef enum _command {
   CMD_REPORT_KEY = 0x51
 } command_t;
 
-typedef struct packet {
-  command_t command; // First byte is the command.
-  uint16_t data_length; // Next two bytes are the data length, low byte first.
-  uint8_t checksum; // Next byte is the checksum.
-  uint8_t data[MAX_PACKET_DATA]; // And arbitrary data after that.
+// A frame exactly as it is on the line, so that tx_packet can be sent as it
+// is. Both ends are little endian.
+typedef struct __attribute__((packed)) packet {
+  uint8_t start; // 0x3a from the reMarkable, 0x2e from us.
+  uint16_t data_length; // Low byte first.
+  uint8_t command; // One of command_t.
+  uint8_t data[MAX_PACKET_DATA + 1]; // The checksum follows the data.
 } packet_t;
 
+static_assert(sizeof(packet_t) == MAX_PACKET_DATA + PACKET_OVERHEAD, "packet_t has to match the frame layout");
+
+static inline uint8_t packet_checksum(packet_t const *packet) {
+  return packet->data[packet->data_length];
+}
+
+static inline uint16_t packet_frame_len(packet_t const *packet) {
+  return PACKET_OVERHEAD + packet->data_length;
+}
+
 // There is one global incoming and one global outgoing packet.
 extern packet_t rx_packet;
 extern packet_t tx_packet;
@@ -66,22 +86,69 @@ typedef enum rx_state {
 typedef enum rx_result {
   RX_PACKET_RECEIVING = 0,
   RX_PACKET_RECEIVED = 1,
-  RX_PACKET_INVALID_CHECKSUM = 2
+  RX_PACKET_INVALID_CHECKSUM = 2,
+  RX_PACKET_INVALID_FRAME = 3 // Length or command make no sense.
 } rx_result_t;
 
+typedef struct rx_stats {
+  uint32_t frames_received;
+  uint32_t checksum_errors;
+  uint32_t invalid_frames;
+  uint32_t bytes_skipped; // Outside of any frame.
+  uint32_t resyncs;
+  uint32_t frames_salvaged; // Frames found in the bytes of a bad frame.
+  uint32_t last_recovery_us; // From the bad frame to the next good one.
+  uint32_t max_recovery_us;
+} rx_stats_t;
+
+extern rx_stats_t rx_stats;
+
 // Enum for print_packet.
 typedef enum packet_direction {
   DIRECTION_TX,
   DIRECTION_RX
 } packet_direction_t;
 
-void print_packet(packet_t *packet, packet_direction_t direction);
+void print_packet(packet_t const *packet, packet_direction_t direction);
+
+// Whether every frame and key event is printed. The formatting runs from
+// flash and the output can block on the UART, so it's off by default with
+// RMK_RAM_HOT_PATH or RMK_XIP_PROFILE, where it would dwarf what's being
+// measured. 'v' on the console toggles it.
+extern bool packet_log;
 
 void rx_switch_to_init_state();
 rx_result_t rx_process_byte(uint8_t data);
 
+// After a bad frame, the parser goes over the bad frame's bytes again, looking
+// for a frame that started inside of it. While there are such bytes left,
+// feed the parser with rx_process_pending instead of reading from the UART.
+bool rx_resync_pending();
+rx_result_t rx_process_pending();
+
+// True while the parser is waiting for the 0x3a of the next frame and would
+// skip anything else.
+bool rx_is_hunting();
+
+void rx_print_stats();
+
+// Frames a packet from tx_packet and sends it, or adds it to the open batch.
 void tx_write_packet();
 
-char *command_name(command_t command);
+// Between these two, tx_write_packet only collects the frames, and the flush
+// sends them all with one write. A batch that fills up is written early.
+void tx_batch_begin();
+void tx_batch_flush();
+
+typedef struct tx_stats {
+  uint32_t frames;
+  uint32_t writes; // Every frame outside of a batch is one write.
+  uint32_t bytes;
+  uint8_t max_batch_frames;
+} tx_stats_t;
+
+extern tx_stats_t tx_stats;
+
+void tx_print_stats();
 
 #endif
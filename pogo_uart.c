@@ -0,0 +1,269 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include "pico/stdlib.h"
+
+#include "pogo_uart.h"
+#include "packet.h"
+#include "hot_path.h"
+
+#if RMK_POGO_PIO
+#include "hardware/clocks.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/pio.h"
+#include "pogo_uart.pio.h"
+#endif
+
+pogo_uart_stats_t pogo_uart_stats;
+
+#if RMK_POGO_PIO
+
+#define POGO_PIO pio0
+#define POGO_PIO_IRQ PIO0_IRQ_0
+#define FRAME_START 0x3a
+#define FRAME_HEADER_LEN 4 // 0x3a, two length bytes and the command.
+
+// The DMA channel writes every received word in here, wrapping around at the
+// end. The ring has to be aligned to its size for that.
+#define RING_BITS 10
+#define RING_WORDS ((1 << RING_BITS) / 4)
+static uint32_t rx_ring[RING_WORDS] __attribute__((aligned(1 << RING_BITS)));
+static uint32_t rx_read_ix = 0;
+
+static uint sm_rx, sm_tx;
+static int dma_chan;
+
+// Set by the PIO interrupt when a 0x3a has come in.
+static volatile bool frame_start_seen = false;
+
+static void RMK_HOT(pogo_pio_irq)() {
+  if (pio_interrupt_get(POGO_PIO, 0)) {
+    pio_interrupt_clear(POGO_PIO, 0);
+    frame_start_seen = true;
+    pogo_uart_stats.frame_starts++;
+  }
+  if (pio_interrupt_get(POGO_PIO, 1)) {
+    pio_interrupt_clear(POGO_PIO, 1);
+    pogo_uart_stats.framing_errors++;
+  }
+}
+
+static void RMK_HOT(pogo_dma_irq)() {
+  if (dma_channel_get_irq1_status(dma_chan)) {
+    // The transfer count ran out after 2^32 bytes, keep going.
+    dma_channel_acknowledge_irq1(dma_chan);
+    dma_channel_set_trans_count(dma_chan, 0xffffffff, true);
+  }
+}
+
+static inline uint32_t rx_write_ix() {
+  return (dma_hw->ch[dma_chan].write_addr - (uintptr_t)rx_ring) / sizeof(uint32_t);
+}
+
+static inline uint32_t rx_available() {
+  return (rx_write_ix() - rx_read_ix) % RING_WORDS;
+}
+
+// Both programs run at 8 cycles per bit.
+static inline float pio_clkdiv() {
+  return (float)clock_get_hz(clk_sys) / (8 * POGO_UART_BAUD);
+}
+
+static void pio_rx_init(uint offset) {
+  pio_sm_set_consecutive_pindirs(POGO_PIO, sm_rx, POGO_UART_RX_PIN, 1, false);
+  pio_gpio_init(POGO_PIO, POGO_UART_RX_PIN);
+  gpio_pull_up(POGO_UART_RX_PIN);
+
+  pio_sm_config c = pogo_uart_rx_program_get_default_config(offset);
+  sm_config_set_in_pins(&c, POGO_UART_RX_PIN);
+  sm_config_set_jmp_pin(&c, POGO_UART_RX_PIN);
+  sm_config_set_in_shift(&c, true, true, 32);
+  sm_config_set_clkdiv(&c, pio_clkdiv());
+  pio_sm_init(POGO_PIO, sm_rx, offset, &c);
+
+  // The program compares every byte against OSR.
+  pio_sm_put(POGO_PIO, sm_rx, (uint32_t)FRAME_START << 24);
+  pio_sm_exec(POGO_PIO, sm_rx, pio_encode_pull(false, true));
+
+  pio_set_irq0_source_enabled(POGO_PIO, pis_interrupt0, true);
+  pio_set_irq0_source_enabled(POGO_PIO, pis_interrupt1, true);
+  irq_set_exclusive_handler(POGO_PIO_IRQ, pogo_pio_irq);
+  irq_set_enabled(POGO_PIO_IRQ, true);
+
+  dma_chan = dma_claim_unused_channel(true);
+  dma_channel_config dc = dma_channel_get_default_config(dma_chan);
+  channel_config_set_transfer_data_size(&dc, DMA_SIZE_32);
+  channel_config_set_read_increment(&dc, false);
+  channel_config_set_write_increment(&dc, true);
+  channel_config_set_ring(&dc, true, RING_BITS);
+  channel_config_set_dreq(&dc, pio_get_dreq(POGO_PIO, sm_rx, false));
+  dma_channel_configure(dma_chan, &dc, rx_ring, &POGO_PIO->rxf[sm_rx], 0xffffffff, true);
+
+  dma_channel_set_irq1_enabled(dma_chan, true);
+  irq_add_shared_handler(DMA_IRQ_1, pogo_dma_irq, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+  irq_set_enabled(DMA_IRQ_1, true);
+
+  pio_sm_set_enabled(POGO_PIO, sm_rx, true);
+}
+
+static void pio_tx_init(uint offset) {
+  pio_sm_set_pins_with_mask(POGO_PIO, sm_tx, 1u << POGO_UART_TX_PIN, 1u << POGO_UART_TX_PIN);
+  pio_sm_set_pindirs_with_mask(POGO_PIO, sm_tx, 1u << POGO_UART_TX_PIN, 1u << POGO_UART_TX_PIN);
+  pio_gpio_init(POGO_PIO, POGO_UART_TX_PIN);
+
+  pio_sm_config c = pogo_uart_tx_program_get_default_config(offset);
+  sm_config_set_out_shift(&c, true, false, 32);
+  sm_config_set_out_pins(&c, POGO_UART_TX_PIN, 1);
+  sm_config_set_sideset_pins(&c, POGO_UART_TX_PIN);
+  sm_config_set_fifo_join(&c, PIO_FIFO_JOIN_TX);
+  sm_config_set_clkdiv(&c, pio_clkdiv());
+  pio_sm_init(POGO_PIO, sm_tx, offset, &c);
+  pio_sm_set_enabled(POGO_PIO, sm_tx, true);
+}
+
+void pogo_uart_init() {
+  sm_rx = pio_claim_unused_sm(POGO_PIO, true);
+  sm_tx = pio_claim_unused_sm(POGO_PIO, true);
+  pio_rx_init(pio_add_program(POGO_PIO, &pogo_uart_rx_program));
+  pio_tx_init(pio_add_program(POGO_PIO, &pogo_uart_tx_program));
+}
+
+static inline uint32_t gap_us(uint32_t word) {
+  // The idle loop takes two cycles, a quarter of a bit.
+  uint32_t ticks = 0xffffff - (word >> 8);
+  return (uint32_t)((uint64_t)ticks * 1000000 / (4 * POGO_UART_BAUD));
+}
+
+bool RMK_HOT(pogo_uart_is_readable)() {
+  uint32_t available = rx_available();
+  if (!rx_is_hunting()) {
+    return available > 0;
+  }
+
+  // The parser is waiting for a frame start, so nothing before the next 0x3a
+  // matters. Until the PIO program has seen one, we don't even look at the
+  // ring.
+  if (!frame_start_seen) {
+    return false;
+  }
+
+  while (true) {
+    while (available > 0 && (rx_ring[rx_read_ix] & 0xff) != FRAME_START) {
+      rx_read_ix = (rx_read_ix + 1) % RING_WORDS;
+      available--;
+      pogo_uart_stats.bytes_ignored++;
+    }
+    if (available > 0) {
+      return available >= FRAME_HEADER_LEN;
+    }
+
+    // The flag is cleared before looking at the ring again. The interrupt
+    // comes in after the DMA has moved the word, so a 0x3a that arrived
+    // during the scan is either in the ring now, or sets the flag again.
+    frame_start_seen = false;
+    available = rx_available();
+    if (available == 0) {
+      return false;
+    }
+  }
+}
+
+uint8_t RMK_HOT(pogo_uart_getc)() {
+  while (rx_available() == 0) {
+    tight_loop_contents();
+  }
+
+  uint32_t word = rx_ring[rx_read_ix];
+  rx_read_ix = (rx_read_ix + 1) % RING_WORDS;
+
+  pogo_uart_stats.bytes_received++;
+  pogo_uart_stats.last_gap_us = gap_us(word);
+  if (!rx_is_hunting() && pogo_uart_stats.last_gap_us > pogo_uart_stats.max_frame_gap_us) {
+    pogo_uart_stats.max_frame_gap_us = pogo_uart_stats.last_gap_us;
+  }
+
+  return word & 0xff;
+}
+
+void RMK_HOT(pogo_uart_putc)(uint8_t data) {
+  pio_sm_put_blocking(POGO_PIO, sm_tx, data);
+}
+
+void pogo_uart_tx_wait() {
+  while (!pio_sm_is_tx_fifo_empty(POGO_PIO, sm_tx)) {
+    tight_loop_contents();
+  }
+  // The last byte is still being shifted out.
+  busy_wait_us(10 * 1000000 / POGO_UART_BAUD + 1);
+}
+
+void pogo_uart_clock_changed() {
+  pio_sm_set_clkdiv(POGO_PIO, sm_rx, pio_clkdiv());
+  pio_sm_set_clkdiv(POGO_PIO, sm_tx, pio_clkdiv());
+}
+
+#else
+
+void pogo_uart_init() {
+  uart_init(uart1, POGO_UART_BAUD);
+  gpio_set_function(POGO_UART_TX_PIN, GPIO_FUNC_UART);
+  gpio_set_function(POGO_UART_RX_PIN, GPIO_FUNC_UART);
+}
+
+bool RMK_HOT(pogo_uart_is_readable)() {
+  return uart_is_readable(uart1);
+}
+
+uint8_t RMK_HOT(pogo_uart_getc)() {
+  pogo_uart_stats.bytes_received++;
+  return (uint8_t)uart_getc(uart1);
+}
+
+void RMK_HOT(pogo_uart_putc)(uint8_t data) {
+  uart_putc(uart1, data);
+}
+
+void pogo_uart_tx_wait() {
+  uart_tx_wait_blocking(uart1);
+}
+
+void pogo_uart_clock_changed() {
+  uart_set_baudrate(uart1, POGO_UART_BAUD);
+}
+
+#endif
+
+void RMK_HOT(pogo_uart_write_blocking)(uint8_t const *data, size_t len) {
+#if RMK_POGO_PIO
+  for (size_t i = 0; i < len; i++) {
+    pogo_uart_putc(data[i]);
+  }
+#else
+  uart_write_blocking(uart1, data, len);
+#endif
+}
+
+void pogo_uart_print_stats() {
+  printf("Pogo: %lu bytes received", pogo_uart_stats.bytes_received);
+#if RMK_POGO_PIO
+  printf(", %lu frame starts, %lu framing errors, %lu bytes ignored\n",
+    pogo_uart_stats.frame_starts, pogo_uart_stats.framing_errors,
+    pogo_uart_stats.bytes_ignored);
+  printf("Pogo: last idle gap %lu us, longest gap inside a frame %lu us",
+    pogo_uart_stats.last_gap_us, pogo_uart_stats.max_frame_gap_us);
+#endif
+  printf("\n");
+}
@@ -0,0 +1,58 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _POGO_UART_H
+#define _POGO_UART_H
+
+#include "pico/stdlib.h"
+#include "config.h"
+
+// The serial line to the reMarkable's pogo pins. This is either uart1 or,
+// with RMK_POGO_PIO, a UART implemented in PIO (see pogo_uart.pio).
+
+#define POGO_UART_TX_PIN 4
+#define POGO_UART_RX_PIN 5
+#define POGO_UART_BAUD 115200
+
+typedef struct pogo_uart_stats {
+  uint32_t bytes_received;
+  uint32_t frame_starts; // 0x3a bytes seen by the PIO program.
+  uint32_t framing_errors; // Missing stop bit, e.g. a break.
+  uint32_t bytes_ignored; // Skipped without waking the parser.
+  uint32_t last_gap_us; // Idle time before the last received byte.
+  uint32_t max_frame_gap_us; // Longest pause inside of a frame.
+} pogo_uart_stats_t;
+
+extern pogo_uart_stats_t pogo_uart_stats;
+
+void pogo_uart_init();
+
+// With the PIO UART, this stays false while the parser is waiting for a frame
+// start and no 0x3a has arrived, and then until the whole frame header is
+// there.
+bool pogo_uart_is_readable();
+uint8_t pogo_uart_getc();
+
+void pogo_uart_putc(uint8_t data);
+void pogo_uart_write_blocking(uint8_t const *data, size_t len);
+
+// Waits until everything written has left the pin.
+void pogo_uart_tx_wait();
+
+// Has to be called after clk_sys or clk_peri changed.
+void pogo_uart_clock_changed();
+
+void pogo_uart_print_stats();
+
+#endif
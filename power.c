@@ -0,0 +1,171 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "hardware/pll.h"
+#include "hardware/sync.h"
+#include "hardware/structs/iobank0.h"
+#include "hardware/structs/scb.h"
+#include "hardware/structs/usb.h"
+
+#include "power.h"
+#include "pogo_uart.h"
+
+#define USB_CLOCK_HZ (48 * MHZ)
+
+// USB needs at least 20 ms of resume signalling from the host before the bus
+// may carry traffic again.
+#define USB_RESUME_MS 20
+
+static void clocks_changed() {
+  uart_set_baudrate(uart_default, PICO_DEFAULT_UART_BAUD_RATE);
+  pogo_uart_clock_changed();
+}
+
+static void clocks_down() {
+  clock_configure(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX,
+    CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB, USB_CLOCK_HZ, USB_CLOCK_HZ);
+  clock_configure(clk_peri, 0, CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB,
+    USB_CLOCK_HZ, USB_CLOCK_HZ);
+  pll_deinit(pll_sys);
+  clocks_changed();
+}
+
+static void peri_from_usb_pll() {
+  clock_configure(clk_peri, 0, CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB,
+    USB_CLOCK_HZ, USB_CLOCK_HZ);
+}
+
+static void clocks_up() {
+  // This also moves clk_peri back to clk_sys.
+  set_sys_clock_khz(POWER_SYS_CLOCK_KHZ, true);
+#if RMK_IDLE_CLOCK_MS
+  peri_from_usb_pll();
+#endif
+  clocks_changed();
+}
+
+void power_init() {
+#if RMK_IDLE_CLOCK_MS
+  peri_from_usb_pll();
+#endif
+}
+
+void power_set_clock(power_clock_t clock) {
+  uint32_t aux_src = CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_SYS;
+  uint32_t hz = POWER_SYS_CLOCK_KHZ * KHZ;
+  if (clock == POWER_CLOCK_IDLE) {
+    aux_src = CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB;
+    hz = USB_CLOCK_HZ;
+  }
+  clock_configure(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLKSRC_CLK_SYS_AUX, aux_src, hz, hz);
+
+  // The UARTs run from clk_peri, which power_init took off clk_sys. The PIO
+  // UART runs from clk_sys.
+#if RMK_POGO_PIO
+  pogo_uart_clock_changed();
+#endif
+}
+
+// A character is over after 10 bits, and the line goes back to idle high.
+// Twice that is plenty of margin.
+#define POGO_CHAR_US (2 * 10 * 1000000 / POGO_UART_BAUD)
+
+static inline bool pogo_edge_seen() {
+  uint32_t events = iobank0_hw->intr[POGO_UART_RX_PIN / 8] >> (4 * (POGO_UART_RX_PIN % 8));
+  return events & GPIO_IRQ_EDGE_FALL;
+}
+
+// A sleeping or detached reMarkable holds RX low (see session.h), which
+// starts with the same falling edge as a start bit. Only a line that comes
+// back up within a character is the reMarkable talking to us. After a break,
+// the next falling edge can only come once the line has been high again.
+static bool pogo_start_bit() {
+  gpio_acknowledge_irq(POGO_UART_RX_PIN, GPIO_IRQ_EDGE_FALL);
+  irq_clear(IO_IRQ_BANK0);
+  uint32_t start = time_us_32();
+  while (time_us_32() - start < POGO_CHAR_US) {
+    if (gpio_get(POGO_UART_RX_PIN)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+power_wake_t power_suspend() {
+  // Whatever we still have to say, like the answer to CMD_ENTER_SUSPEND, has
+  // to be out before the clocks change.
+  pogo_uart_tx_wait();
+  uart_tx_wait_blocking(uart_default);
+
+  // Without SOFs, the keyboard suspends itself after 3 ms.
+  uint32_t sie_ctrl = usb_hw->sie_ctrl & (USB_SIE_CTRL_SOF_EN_BITS | USB_SIE_CTRL_KEEP_ALIVE_EN_BITS);
+  hw_clear_bits(&usb_hw->sie_ctrl, sie_ctrl);
+
+  // TinyUSB's interrupt handler doesn't know about resume, so it's kept off
+  // while we sleep. With SEVONPEND, the wake-up sources still end the WFE by
+  // becoming pending. The GPIO interrupt isn't enabled in the NVIC at all, so
+  // nothing clears its pending bit but us. It has to be clear before every
+  // WFE, or the next edge doesn't make it pending again and there's no event.
+  // An edge that's latched already keeps the interrupt line up and pends it
+  // again right away.
+  irq_set_enabled(USBCTRL_IRQ, false);
+  usb_hw->sie_status = USB_SIE_STATUS_RESUME_BITS;
+  hw_set_bits(&usb_hw->inte, USB_INTE_HOST_RESUME_BITS);
+  gpio_set_irq_enabled(POGO_UART_RX_PIN, GPIO_IRQ_EDGE_FALL, true);
+  irq_clear(IO_IRQ_BANK0);
+
+  clocks_down();
+
+  hw_set_bits(&scb_hw->scr, M0PLUS_SCR_SEVONPEND_BITS);
+  power_wake_t reason;
+  while (true) {
+    if (usb_hw->ints & USB_INTS_HOST_CONN_DIS_BITS) {
+      reason = POWER_WAKE_UNPLUG;
+      break;
+    }
+    if (usb_hw->ints & USB_INTS_HOST_RESUME_BITS) {
+      reason = POWER_WAKE_KEYBOARD;
+      break;
+    }
+    if (pogo_edge_seen() && pogo_start_bit()) {
+      reason = POWER_WAKE_POGO;
+      break;
+    }
+    irq_clear(IO_IRQ_BANK0);
+    __wfe();
+  }
+  hw_clear_bits(&scb_hw->scr, M0PLUS_SCR_SEVONPEND_BITS);
+
+  clocks_up();
+
+  gpio_set_irq_enabled(POGO_UART_RX_PIN, GPIO_IRQ_EDGE_FALL, false);
+  gpio_acknowledge_irq(POGO_UART_RX_PIN, GPIO_IRQ_EDGE_FALL);
+  irq_clear(IO_IRQ_BANK0);
+
+  if (reason != POWER_WAKE_UNPLUG) {
+    hw_set_bits(&usb_hw->sie_ctrl, USB_SIE_CTRL_RESUME_BITS);
+    sleep_ms(USB_RESUME_MS);
+  }
+  hw_clear_bits(&usb_hw->inte, USB_INTE_HOST_RESUME_BITS);
+  usb_hw->sie_status = USB_SIE_STATUS_RESUME_BITS;
+  hw_set_bits(&usb_hw->sie_ctrl, sie_ctrl);
+  irq_set_enabled(USBCTRL_IRQ, true);
+
+  return reason;
+}
@@ -0,0 +1,56 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _POWER_H
+#define _POWER_H
+
+#include "pico/stdlib.h"
+#include "config.h"
+
+// System clock while awake. PIO-USB needs a multiple of 12 MHz.
+#if RMK_PIO_USB_HOST
+#define POWER_SYS_CLOCK_KHZ 120000
+#else
+#define POWER_SYS_CLOCK_KHZ 125000
+#endif
+
+typedef enum power_clock {
+  POWER_CLOCK_FULL = 0, // POWER_SYS_CLOCK_KHZ from the system PLL.
+  POWER_CLOCK_IDLE = 1, // 48 MHz from the USB PLL, the system PLL keeps running.
+  POWER_CLOCK_SUSPEND = 2, // In power_suspend.
+  POWER_CLOCKS
+} power_clock_t;
+
+typedef enum power_wake {
+  POWER_WAKE_POGO = 0, // The reMarkable is talking to us, not just holding RX low.
+  POWER_WAKE_KEYBOARD = 1, // Remote wakeup, i.e. a key was pressed.
+  POWER_WAKE_UNPLUG = 2 // The keyboard went away.
+} power_wake_t;
+
+// Suspends the USB bus, runs the system off the 48 MHz USB PLL with the
+// system PLL stopped and sleeps until one of the above happens. Everything is
+// back to normal when this returns, including the bus. This needs the keyboard
+// on the native USB port, so it isn't used with RMK_PIO_USB_HOST.
+power_wake_t power_suspend();
+
+// With RMK_IDLE_CLOCK_MS, moves clk_peri to the USB PLL, so that the UART
+// dividers don't depend on clk_sys any more. Call this first thing at boot,
+// before any UART is set up.
+void power_init();
+
+// Switches clk_sys to POWER_CLOCK_FULL or POWER_CLOCK_IDLE. Only for
+// RMK_IDLE_CLOCK_MS, since it relies on power_init.
+void power_set_clock(power_clock_t clock);
+
+#endif
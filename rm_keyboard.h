@@ -18,8 +18,11 @@
 #include "app.h"
 
 #define KEY(ROW, COL) (ROW << 1 | COL << 4)
+#define KEYCODE_INVALID 0xff
+
+// HID usage to reMarkable key code, KEYCODE_INVALID for unmapped keys.
+extern const uint8_t keycodes[256];
 
-void rmk_init();
 void rmk_process_event(key_event_t *event);
 
 #endif
@@ -0,0 +1,183 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include "pico/stdlib.h"
+
+#include "config.h"
+#include "rtos.h"
+
+#if RMK_FREERTOS
+
+#include "pico/stdio/driver.h"
+#include "pico/stdio_uart.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "stream_buffer.h"
+
+#include "app.h"
+#include "crash.h"
+#include "packet.h"
+#include "pogo_uart.h"
+
+#define POGO_TASK_PRIORITY (configMAX_PRIORITIES - 1)
+#define USB_TASK_PRIORITY (configMAX_PRIORITIES - 2)
+#define LOG_TASK_PRIORITY (tskIDLE_PRIORITY + 2)
+#define HOUSEKEEPING_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+
+#define POGO_TASK_STACK 1024 // Words.
+#define USB_TASK_STACK 1024
+#define LOG_TASK_STACK 256
+#define HOUSEKEEPING_TASK_STACK 1024
+
+#define LOG_BUFFER_SIZE 4096
+#define HOUSEKEEPING_PERIOD_MS 10
+
+static TaskHandle_t pogo_task_handle;
+#if !RMK_RTT
+static StreamBufferHandle_t log_buffer;
+#endif
+
+// Bumped by the tasks the watchdog depends on.
+static volatile uint32_t pogo_loops, usb_loops;
+
+void rtos_notify_pogo() {
+  if (pogo_task_handle != NULL) {
+    xTaskNotifyGive(pogo_task_handle);
+  }
+}
+
+void rtos_notify_pogo_from_isr() {
+  if (pogo_task_handle != NULL) {
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(pogo_task_handle, &woken);
+    portYIELD_FROM_ISR(woken);
+  }
+}
+
+void rtos_lock() {
+  taskENTER_CRITICAL();
+}
+
+void rtos_unlock() {
+  taskEXIT_CRITICAL();
+}
+
+static void pogo_task(void *unused) {
+  while (true) {
+    crash_loop(app_state.mode);
+    pogo_loops++;
+    app_pogo_step();
+
+    // Key events wake us right away. The UART is only polled once per tick
+    // while it's quiet, its FIFO holds about 3 ms at 115200 baud.
+    if (!pogo_uart_is_readable() && !rx_resync_pending()) {
+      ulTaskNotifyTake(pdTRUE, 1);
+    }
+  }
+}
+
+static void usb_task(void *unused) {
+  while (true) {
+    usb_loops++;
+    app_usb_step();
+  }
+}
+
+#if !RMK_RTT
+// The SDK's stdio takes a mutex around out_chars, so there's only ever one
+// writer to the stream buffer, as it requires.
+static void log_out_chars(const char *buf, int len) {
+  while (len > 0) {
+    size_t sent = xStreamBufferSend(log_buffer, buf, len, portMAX_DELAY);
+    buf += sent;
+    len -= sent;
+  }
+}
+
+static int log_in_chars(char *buf, int len) {
+  return stdio_uart.in_chars(buf, len);
+}
+
+static stdio_driver_t log_driver = {
+  .out_chars = log_out_chars,
+  .in_chars = log_in_chars,
+#if PICO_STDIO_ENABLE_CRLF_SUPPORT
+  .crlf_enabled = PICO_STDIO_DEFAULT_CRLF
+#endif
+};
+
+static void log_task(void *unused) {
+  char chunk[64];
+  while (true) {
+    size_t len = xStreamBufferReceive(log_buffer, chunk, sizeof(chunk), portMAX_DELAY);
+    stdio_uart.out_chars(chunk, len);
+  }
+}
+#endif
+
+static void housekeeping_task(void *unused) {
+  uint32_t pogo_seen = pogo_loops, usb_seen = usb_loops;
+  TickType_t last_wake = xTaskGetTickCount();
+
+  crash_watchdog_start();
+
+  while (true) {
+    app_handle_console(getchar_timeout_us(0));
+
+    if (pogo_loops != pogo_seen && usb_loops != usb_seen) {
+      crash_watchdog_feed();
+      pogo_seen = pogo_loops;
+      usb_seen = usb_loops;
+    }
+
+    xTaskDelayUntil(&last_wake, pdMS_TO_TICKS(HOUSEKEEPING_PERIOD_MS));
+  }
+}
+
+void rtos_start() {
+#if !RMK_RTT
+  // With RMK_RTT, printing is a copy into RAM already, it doesn't need a task.
+  log_buffer = xStreamBufferCreate(LOG_BUFFER_SIZE, 1);
+  stdio_set_driver_enabled(&stdio_uart, false);
+  stdio_set_driver_enabled(&log_driver, true);
+#endif
+
+  // TinyUSB's interrupt stays on core 0, where main ran tusb_init, together
+  // with the pogo task. It only queues events for the usb task, and it has to
+  // be on the core that suspends, since power_suspend masks it.
+  xTaskCreateAffinitySet(pogo_task, "pogo", POGO_TASK_STACK, NULL, POGO_TASK_PRIORITY,
+    1 << 0, &pogo_task_handle);
+  xTaskCreateAffinitySet(usb_task, "usb", USB_TASK_STACK, NULL, USB_TASK_PRIORITY,
+    1 << 1, NULL);
+#if !RMK_RTT
+  xTaskCreate(log_task, "log", LOG_TASK_STACK, NULL, LOG_TASK_PRIORITY, NULL);
+#endif
+  xTaskCreate(housekeeping_task, "housekeeping", HOUSEKEEPING_TASK_STACK, NULL,
+    HOUSEKEEPING_TASK_PRIORITY, NULL);
+
+  vTaskStartScheduler();
+
+  panic("FreeRTOS scheduler returned");
+}
+
+void vApplicationStackOverflowHook(TaskHandle_t task, char *name) {
+  panic("Stack overflow in task %s", name);
+}
+
+void vApplicationMallocFailedHook() {
+  panic("FreeRTOS heap exhausted");
+}
+
+#endif
@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _RTOS_H
+#define _RTOS_H
+
+#include "pico/stdlib.h"
+#include "config.h"
+
+// With RMK_FREERTOS, the main loop is split into tasks on FreeRTOS SMP:
+//
+//   pogo          Highest priority, core 0. Receives and answers frames,
+//                 sends keys and keep-alives (app_pogo_step). Suspending
+//                 happens in here too.
+//   usb           Core 1. Runs TinyUSB, which blocks on its event queue
+//                 between interrupts (app_usb_step). The USB interrupt itself
+//                 stays on core 0.
+//   log           Writes what was printed to the debug UART, so printf
+//                 doesn't block the pogo task for as long as it takes to
+//                 send the text at 115200 baud.
+//   housekeeping  Lowest priority. Debug console and the watchdog, which is
+//                 only fed while both the pogo and the usb task get around.
+
+#if RMK_FREERTOS
+
+// Creates the tasks and starts the scheduler. Doesn't return.
+void rtos_start();
+
+// Wakes the pogo task, which otherwise only looks at the line once per tick.
+void rtos_notify_pogo();
+// The same for interrupt handlers.
+void rtos_notify_pogo_from_isr();
+
+// Keeps the other core and interrupts out, for state shared between the usb
+// and the pogo task. Only for a few instructions.
+void rtos_lock();
+void rtos_unlock();
+
+#else
+
+static inline void rtos_notify_pogo() {
+}
+
+static inline void rtos_notify_pogo_from_isr() {
+}
+
+static inline void rtos_lock() {
+}
+
+static inline void rtos_unlock() {
+}
+
+#endif
+
+#endif
@@ -0,0 +1,147 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <string.h>
+#include "pico/stdlib.h"
+
+#include "config.h"
+#include "rtt.h"
+
+#if RMK_RTT
+
+#include "pico/stdio/driver.h"
+#include "hardware/sync.h"
+
+#include "app.h"
+#include "clock_scaling.h"
+#include "command.h"
+#include "packet.h"
+#include "pogo_uart.h"
+#include "session.h"
+#include "tap_hold.h"
+
+#define RTT_UP_BUFFER_SIZE 4096
+#define RTT_DOWN_BUFFER_SIZE 16
+
+// SEGGER's "no block, trim" mode: write what fits, drop the rest.
+#define RTT_MODE_NO_BLOCK_TRIM 1
+
+typedef struct rtt_control_block {
+  char id[16];
+  int32_t max_up_buffers;
+  int32_t max_down_buffers;
+  rtt_buffer_t up[1];
+  rtt_buffer_t down[1];
+} rtt_control_block_t;
+
+#define RTT_COUNTERS 10
+
+typedef struct rtt_counters {
+  char id[16];
+  uint32_t version;
+  uint32_t count;
+  rtt_counter_t counters[RTT_COUNTERS];
+} rtt_counters_t;
+
+rtt_stats_t rtt_stats;
+
+// Everything a probe looks at is in RAM, names included, so that a RAM dump
+// has all of it.
+static char up_name[] = "Terminal";
+static char down_name[] = "Terminal";
+static char up_buffer[RTT_UP_BUFFER_SIZE];
+static char down_buffer[RTT_DOWN_BUFFER_SIZE];
+
+rtt_control_block_t _SEGGER_RTT = {
+  .max_up_buffers = 1,
+  .max_down_buffers = 1,
+  .up = { { up_name, up_buffer, RTT_UP_BUFFER_SIZE, 0, 0, RTT_MODE_NO_BLOCK_TRIM } },
+  .down = { { down_name, down_buffer, RTT_DOWN_BUFFER_SIZE, 0, 0, RTT_MODE_NO_BLOCK_TRIM } }
+};
+
+#define COUNTER(name, variable) { name, &variable, sizeof(variable) }
+
+rtt_counters_t rmk_counters = {
+  .id = "RMK COUNTERS",
+  .version = RTT_COUNTERS_VERSION,
+  .count = RTT_COUNTERS,
+  .counters = {
+    COUNTER("app_state", app_state),
+    COUNTER("app", app_stats),
+    COUNTER("rx", rx_stats),
+    COUNTER("tx", tx_stats),
+    COUNTER("pogo_uart", pogo_uart_stats),
+    COUNTER("session", session_stats),
+    COUNTER("cmd", cmd_counters),
+    COUNTER("tap_hold", tap_hold_stats),
+    COUNTER("clock", clock_scaling_stats),
+    COUNTER("rtt", rtt_stats)
+  }
+};
+
+static void rtt_out_chars(const char *buf, int length) {
+  rtt_buffer_t *up = &_SEGGER_RTT.up[0];
+  uint32_t write = up->write_offset;
+  uint32_t read = up->read_offset;
+
+  // One byte stays free, so that a full ring doesn't look empty.
+  uint32_t space = (read + up->size - write - 1) % up->size;
+  uint32_t count = MIN((uint32_t)length, space);
+  rtt_stats.dropped += length - count;
+  rtt_stats.bytes += count;
+
+  uint32_t first = MIN(count, up->size - write);
+  memcpy(up->buffer + write, buf, first);
+  memcpy(up->buffer, buf + first, count - first);
+
+  // The data has to be in RAM before the probe sees the new offset.
+  __dmb();
+  up->write_offset = (write + count) % up->size;
+}
+
+static int rtt_in_chars(char *buf, int length) {
+  rtt_buffer_t *down = &_SEGGER_RTT.down[0];
+  uint32_t read = down->read_offset;
+  uint32_t write = down->write_offset;
+  if (read == write) {
+    return PICO_ERROR_NO_DATA;
+  }
+  __dmb();
+
+  int count = 0;
+  while (read != write && count < length) {
+    buf[count++] = down->buffer[read];
+    read = (read + 1) % down->size;
+  }
+  down->read_offset = read;
+  return count;
+}
+
+static stdio_driver_t rtt_stdio_driver = {
+  .out_chars = rtt_out_chars,
+  .in_chars = rtt_in_chars,
+#if PICO_STDIO_ENABLE_CRLF_SUPPORT
+  .crlf_enabled = PICO_STDIO_DEFAULT_CRLF
+#endif
+};
+
+void rtt_init() {
+  // The id goes in last. A probe that scans RAM before then finds nothing,
+  // rather than a block that isn't set up yet.
+  __dmb();
+  strcpy(_SEGGER_RTT.id, "SEGGER RTT");
+  stdio_set_driver_enabled(&rtt_stdio_driver, true);
+}
+
+#endif
@@ -0,0 +1,76 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _RTT_H
+#define _RTT_H
+
+#include "pico/stdlib.h"
+#include "config.h"
+
+// With RMK_RTT, stdio goes into RAM instead of the debug UART, in the layout
+// of SEGGER RTT: a control block with the id "SEGGER RTT" (the _SEGGER_RTT
+// symbol) describes an up buffer that printf writes into and a down buffer
+// the console reads from. A debug probe reads and writes them over SWD while
+// the adapter runs, e.g. with OpenOCD:
+//
+//   rtt setup 0x20000000 0x42000 "SEGGER RTT"
+//   rtt start
+//   rtt server start 9090 0
+//
+// Printing only copies into the ring. If the probe doesn't keep up, what
+// doesn't fit is dropped, the adapter never waits for it. Without a probe
+// reading, that means the ring keeps the first 4 KB after boot.
+//
+// Next to it, a counters block with the id "RMK COUNTERS" (the rmk_counters
+// symbol) lists the statistics structs by name, address and size. They're
+// read in place, so keeping them costs nothing. scripts/rtt_decode.py decodes
+// both from a RAM dump.
+
+#define RTT_COUNTERS_VERSION 1
+
+typedef struct rtt_buffer {
+  const char *name;
+  char *buffer;
+  uint32_t size;
+  volatile uint32_t write_offset; // Written by the producer.
+  volatile uint32_t read_offset; // Written by the consumer.
+  uint32_t flags;
+} rtt_buffer_t;
+
+typedef struct rtt_counter {
+  char name[12];
+  void const *address;
+  uint32_t size;
+} rtt_counter_t;
+
+typedef struct rtt_stats {
+  uint32_t bytes;
+  uint32_t dropped; // Because the probe didn't read them in time.
+} rtt_stats_t;
+
+#if RMK_RTT
+
+extern rtt_stats_t rtt_stats;
+
+// Makes the up buffer a stdio driver. Call this before anything is printed.
+void rtt_init();
+
+#else
+
+static inline void rtt_init() {
+}
+
+#endif
+
+#endif
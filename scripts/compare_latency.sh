@@ -0,0 +1,51 @@
+#!/bin/sh
+
+# Run the same simulator workload against the bare metal and the FreeRTOS
+# build of the adapter a number of times, and print the worst key latency and
+# queue to TX time each build had. The remaining arguments go to the
+# simulator, for example:
+#
+#   scripts/compare_latency.sh build-sim 10 -n 10 -i 5 -r 4
+
+if [ $# -lt 2 ]; then
+  echo "Usage: $0 SIM_BUILD_DIR RUNS [SIMULATOR OPTIONS]" >&2
+  exit 2
+fi
+
+build=$1
+runs=$2
+shift 2
+
+status=0
+for sim in rmk_sim rmk_sim_rtos; do
+  worst_latency=0
+  worst_queue=0
+  failed=0
+
+  run=0
+  while [ $run -lt "$runs" ]; do
+    run=$((run + 1))
+    if ! report=$("$build/$sim" "$@"); then
+      failed=$((failed + 1))
+    fi
+
+    # "Key latency: p50 75 us, p99 206 us, max 1109 us"
+    latency=$(echo "$report" | sed -n 's/^Key latency:.* max \([0-9]*\) us$/\1/p')
+    # "Queue to TX: max 1033 us in the adapter"
+    queue=$(echo "$report" | sed -n 's/^Queue to TX: max \([0-9]*\) us.*/\1/p')
+    if [ -n "$latency" ] && [ "$latency" -gt $worst_latency ]; then
+      worst_latency=$latency
+    fi
+    if [ -n "$queue" ] && [ "$queue" -gt $worst_queue ]; then
+      worst_queue=$queue
+    fi
+  done
+
+  echo "$sim: $runs runs, worst key latency $worst_latency us," \
+    "worst queue to TX $worst_queue us, $failed failed"
+  if [ $failed -gt 0 ]; then
+    status=1
+  fi
+done
+
+exit $status
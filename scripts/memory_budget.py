@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+
+# Per-module RAM and flash usage from the GNU ld map file of the firmware
+# (rm_keyboard_adapter.elf.map), checked against the budgets in a config file
+# (see memory_budget.cfg). Exits with 1 if a budget is exceeded.
+#
+# Every input section is charged to the object file it came from. The adapter's
+# own sources are reported by name, the SDK, TinyUSB, PIO-USB, FreeRTOS and the C
+# library are grouped. Sections that are copied from flash to RAM at boot (.data and, with
+# RMK_RAM_HOT_PATH, the hot path) count towards both.
+
+import re
+import sys
+
+FLASH_BASE, FLASH_END = 0x10000000, 0x11000000
+RAM_BASE, RAM_END = 0x20000000, 0x20042000
+
+OUTPUT_SECTION = re.compile(r"^(\.\S+)(?:\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)(?:\s+load address 0x([0-9a-f]+))?)?\s*$")
+OUTPUT_SECTION_CONT = re.compile(r"^\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)(?:\s+load address 0x([0-9a-f]+))?\s*$")
+INPUT_SECTION = re.compile(r"^ (\S+)(?:\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)(?:\s+(\S.*))?)?\s*$")
+INPUT_SECTION_CONT = re.compile(r"^\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S.*)$")
+
+def in_flash(address):
+    return address is not None and FLASH_BASE <= address < FLASH_END
+
+def in_ram(address):
+    return address is not None and RAM_BASE <= address < RAM_END
+
+def module_of(path):
+    if path is None:
+        return "(padding)"
+    if re.search(r"lib(c|g|gcc|m|nosys|c_nano|stdc\+\+)[^/]*\.a\(", path):
+        return "libc"
+    if "Pico-PIO-USB" in path or "pio_usb" in path:
+        return "pio-usb"
+    if "tinyusb" in path:
+        return "tinyusb"
+    if "FreeRTOS" in path:
+        return "freertos"
+    if re.search(r"pico[-_]sdk|/rp2_common/|/rp2040/|/common/|boot_stage2|bs2_default", path):
+        return "pico-sdk"
+    name = re.sub(r"\.(c|S|s)\.(obj|o)$", "", path.split("/")[-1])
+    return name or "(other)"
+
+def parse_map(path):
+    usage = {}
+    output = None # (ram, flash) of the current output section
+    pending_output = None
+    pending_input = None
+
+    def charge(module, size):
+        ram, flash = usage.get(module, (0, 0))
+        if output[0]:
+            ram += size
+        if output[1]:
+            flash += size
+        usage[module] = (ram, flash)
+
+    def start_output(vma, lma):
+        vma = int(vma, 16)
+        lma = int(lma, 16) if lma else None
+        return (in_ram(vma), in_flash(vma) or in_flash(lma))
+
+    with open(path, errors="replace") as map_file:
+        started = False
+        for line in map_file:
+            line = line.rstrip("\n")
+            if not started:
+                started = line.startswith("Linker script and memory map")
+                continue
+
+            if pending_output is not None:
+                match = OUTPUT_SECTION_CONT.match(line)
+                output = start_output(match.group(1), match.group(3)) if match else None
+                pending_output = None
+                continue
+
+            if pending_input is not None:
+                pending_input = None
+                match = INPUT_SECTION_CONT.match(line)
+                if match:
+                    charge(module_of(match.group(3)), int(match.group(2), 16))
+                    continue
+
+            if line.startswith("."):
+                match = OUTPUT_SECTION.match(line)
+                if not match:
+                    output = None
+                elif match.group(2) is None:
+                    pending_output = match.group(1)
+                else:
+                    output = start_output(match.group(2), match.group(4))
+                continue
+
+            if output is None or not output[0] and not output[1]:
+                continue
+
+            match = INPUT_SECTION.match(line)
+            if not match:
+                continue
+            if match.group(2) is None:
+                # Long section names push the rest onto the next line. Linker
+                # script patterns like *(.text*) look the same, but aren't
+                # followed by a size.
+                pending_input = match.group(1)
+            else:
+                charge(module_of(match.group(4)), int(match.group(3), 16))
+
+    return usage
+
+def parse_size(text):
+    text = text.strip().upper()
+    if text == "-":
+        return None
+    if text.endswith("K"):
+        return int(text[:-1], 0) * 1024
+    return int(text, 0)
+
+def parse_budget(path):
+    budget = {}
+    with open(path) as cfg:
+        for number, line in enumerate(cfg, 1):
+            line = line.split("#", 1)[0].strip()
+            if not line:
+                continue
+            fields = line.split()
+            if len(fields) != 3:
+                raise ValueError(f"{path}:{number}: expected MODULE RAM FLASH")
+            budget[fields[0]] = (parse_size(fields[1]), parse_size(fields[2]))
+    return budget
+
+def main():
+    if len(sys.argv) != 3:
+        print(f"Usage: {sys.argv[0]} MAP BUDGET", file=sys.stderr)
+        return 2
+
+    usage = parse_map(sys.argv[1])
+    budget = parse_budget(sys.argv[2])
+    if not usage:
+        print(f"No sections found in {sys.argv[1]}", file=sys.stderr)
+        return 2
+
+    usage["total"] = (sum(ram for ram, _ in usage.values()), sum(flash for _, flash in usage.values()))
+
+    over = []
+    print(f"{'Module':<16} {'RAM':>8} {'budget':>8} {'Flash':>8} {'budget':>8}")
+    modules = sorted(module for module in usage if module != "total") + ["total"]
+    for module in modules:
+        ram, flash = usage[module]
+        ram_budget, flash_budget = budget.get(module, (None, None))
+        columns = []
+        exceeded = False
+        for used, limit, kind in ((ram, ram_budget, "RAM"), (flash, flash_budget, "flash")):
+            columns.append(f"{used:>8} {'-' if limit is None else limit:>8}")
+            if limit is not None and used > limit:
+                over.append(f"{module} uses {used} bytes of {kind}, budget is {limit}")
+                exceeded = True
+        print(f"{module:<16} {columns[0]} {columns[1]}{'  OVER' if exceeded else ''}")
+
+    for module in budget:
+        if module not in usage:
+            print(f"Note: no sections found for {module}", file=sys.stderr)
+
+    if over:
+        print(file=sys.stderr)
+        for message in over:
+            print(f"ERROR: {message}", file=sys.stderr)
+        return 1
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())
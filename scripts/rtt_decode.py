@@ -0,0 +1,141 @@
+#!/usr/bin/env python3
+
+# Decode the RTT log ring and the counters table (see rtt.h) from a dump of
+# the adapter's RAM, taken over SWD while it runs, e.g. with OpenOCD:
+#
+#   dump_image ram.bin 0x20000000 0x42000
+#
+# The log is printed first, then every counters struct with its fields. With
+# --unread, only the part of the log the probe hasn't read yet is printed.
+
+import struct
+import sys
+
+RAM_BASE = 0x20000000
+
+# Layouts of the structs in the counters table, as arm-none-eabi-gcc lays them
+# out. Structs without an entry here are printed as words.
+COUNTERS = {
+    "app_state": ("<I4xQQ?7x", "mode last_keep_alive resumed waiting_for_key"),
+    "app": ("<IIB3xIIII8IIIIB3x", "key_events_queued key_events_dropped max_queue_depth suspends "
+        "keyboard_wakes last_resume_to_key_us max_resume_to_key_us "
+        "key_latency[0] key_latency[1] key_latency[2] key_latency[3] "
+        "key_latency[4] key_latency[5] key_latency[6] key_latency[7] "
+        "max_key_latency_us key_syncs keys_synced last_keys_synced"),
+    "rx": ("<8I", "frames_received checksum_errors invalid_frames bytes_skipped resyncs "
+        "frames_salvaged last_recovery_us max_recovery_us"),
+    "tx": ("<IIIB3x", "frames writes bytes max_batch_frames"),
+    "pogo_uart": ("<6I", "bytes_received frame_starts framing_errors bytes_ignored "
+        "last_gap_us max_frame_gap_us"),
+    "session": ("<5I", "link_losses reconnects cached_answers last_reconnect_us max_reconnect_us"),
+    "tap_hold": ("<5I4xQ", "taps holds holds_by_key last_decision_us max_decision_us "
+        "total_decision_us"),
+    "clock": ("<3Q4I", "full_us idle_us suspend_us idles boosts last_boost_us max_boost_us"),
+    "rtt": ("<II", "bytes dropped"),
+}
+
+def word(ram, address):
+    offset = address - RAM_BASE
+    if offset < 0 or offset + 4 > len(ram):
+        raise ValueError(f"0x{address:08x} is outside of the dump")
+    return struct.unpack_from("<I", ram, offset)[0]
+
+def block(ram, address, size):
+    offset = address - RAM_BASE
+    if offset < 0 or offset + size > len(ram):
+        raise ValueError(f"0x{address:08x}+{size} is outside of the dump")
+    return ram[offset:offset + size]
+
+def find_id(ram, name):
+    # The ids are 16 byte char arrays, the string literal that fills them
+    # lives in flash and isn't part of the dump.
+    key = name.encode() + b"\0"
+    offset = ram.find(key)
+    while offset >= 0 and offset % 4:
+        offset = ram.find(key, offset + 1)
+    return offset
+
+def decode_log(ram, unread):
+    offset = find_id(ram, "SEGGER RTT")
+    if offset < 0:
+        print("No RTT control block found", file=sys.stderr)
+        return False
+
+    # char id[16], int max_up, int max_down, then the up buffers.
+    max_up = struct.unpack_from("<i", ram, offset + 16)[0]
+    if max_up < 1:
+        print("RTT control block has no up buffer", file=sys.stderr)
+        return False
+    address, size, write, read, flags = struct.unpack_from("<IIIII", ram, offset + 28)
+    data = block(ram, address, size)
+
+    if unread:
+        if write >= read:
+            log = data[read:write]
+        else:
+            log = data[read:] + data[:write]
+    else:
+        # Without a probe reading, the ring is filled once and then stops,
+        # oldest first from the start.
+        log = data[write:] + data[:write]
+        log = log.lstrip(b"\0")
+
+    print(f"=== RTT log at 0x{RAM_BASE + offset:08x} ({len(log)} of {size} bytes) ===")
+    sys.stdout.write(log.decode(errors="replace"))
+    if log and not log.endswith(b"\n"):
+        print()
+    return True
+
+def decode_counters(ram):
+    offset = find_id(ram, "RMK COUNTERS")
+    if offset < 0:
+        print("No counters table found", file=sys.stderr)
+        return False
+
+    version, count = struct.unpack_from("<II", ram, offset + 16)
+    print(f"=== Counters at 0x{RAM_BASE + offset:08x} (version {version}) ===")
+
+    for i in range(count):
+        entry = offset + 24 + i * 20
+        name = ram[entry:entry + 12].split(b"\0", 1)[0].decode(errors="replace")
+        address, size = struct.unpack_from("<II", ram, entry + 12)
+        data = block(ram, address, size)
+        print(f"{name}:")
+
+        if name == "cmd":
+            for slot in range(size // 8):
+                handled, rejected = struct.unpack_from("<II", data, slot * 8)
+                if handled or rejected:
+                    print(f"  slot {slot}: handled {handled}, rejected {rejected}")
+            continue
+
+        layout = COUNTERS.get(name)
+        if layout is not None and struct.calcsize(layout[0]) == size:
+            for field, value in zip(layout[1].split(), struct.unpack(layout[0], data)):
+                print(f"  {field}: {value}")
+        else:
+            words = struct.unpack_from(f"<{size // 4}I", data)
+            print("  " + " ".join(f"{value:08x}" for value in words))
+    return True
+
+def main():
+    args = sys.argv[1:]
+    unread = "--unread" in args
+    args = [arg for arg in args if arg != "--unread"]
+    if len(args) != 1:
+        print(f"Usage: {sys.argv[0]} [--unread] RAM_DUMP", file=sys.stderr)
+        return 2
+
+    with open(args[0], "rb") as dump:
+        ram = dump.read()
+
+    try:
+        found_log = decode_log(ram, unread)
+        found_counters = decode_counters(ram)
+    except ValueError as error:
+        print(f"Bad dump: {error}", file=sys.stderr)
+        return 1
+    return 0 if found_log or found_counters else 1
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,36 @@
+#!/usr/bin/env python3
+
+# Extract a binary trace from a debug UART log that contains the output of the
+# 'd' console command (see trace.h). The last trace in the log wins.
+
+import sys
+
+def main():
+    if len(sys.argv) != 3:
+        print(f"Usage: {sys.argv[0]} LOG OUTPUT", file=sys.stderr)
+        return 2
+
+    data = None
+    trace = None
+    with open(sys.argv[1], errors="replace") as log:
+        for line in log:
+            line = line.strip()
+            if line.startswith("TRACE BEGIN"):
+                data = bytearray()
+            elif line == "TRACE END":
+                trace = data
+                data = None
+            elif data is not None:
+                data += bytes.fromhex(line)
+
+    if trace is None:
+        print("No complete trace found", file=sys.stderr)
+        return 1
+
+    with open(sys.argv[2], "wb") as out:
+        out.write(trace)
+    print(f"Wrote {len(trace)} bytes")
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())
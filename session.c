@@ -0,0 +1,147 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+
+#include "session.h"
+#include "pogo_uart.h"
+#include "trace.h"
+#include "hot_path.h"
+
+// A complete frame as it went out on the line, and the request it answered.
+typedef struct cached_answer {
+  uint8_t command;
+  uint8_t request_len;
+  uint8_t request[SESSION_CACHE_REQUEST_LEN];
+  uint16_t frame_len;
+  uint8_t frame[sizeof(packet_t)];
+} cached_answer_t;
+
+session_stats_t session_stats;
+
+static cached_answer_t cache[SESSION_CACHE_ENTRIES];
+static uint8_t cache_count = 0;
+
+static bool link_up = true;
+static bool line_high = true;
+static absolute_time_t line_changed;
+
+static bool reconnecting = false;
+static absolute_time_t link_restored;
+
+session_event_t RMK_HOT(session_task)() {
+  bool high = gpio_get(POGO_UART_RX_PIN);
+  absolute_time_t now = get_absolute_time();
+
+  if (high != line_high) {
+    line_high = high;
+    line_changed = now;
+    return SESSION_NONE;
+  }
+
+  int64_t stable_us = absolute_time_diff_us(line_changed, now);
+  if (link_up && !high && stable_us > SESSION_BREAK_MS * 1000) {
+    link_up = false;
+    reconnecting = false;
+    session_stats.link_losses++;
+    printf("Session: Link lost\n");
+    return SESSION_LINK_LOST;
+  }
+
+  if (!link_up && high && stable_us > SESSION_IDLE_MS * 1000) {
+    link_up = true;
+    reconnecting = true;
+    link_restored = now;
+    printf("Session: Link restored\n");
+    return SESSION_LINK_RESTORED;
+  }
+
+  return SESSION_NONE;
+}
+
+static bool is_cacheable(uint8_t command) {
+  return command == CMD_ATTRIBUTE_READ || command == CMD_GET_AUTH_KEY;
+}
+
+static cached_answer_t const *find_answer() {
+  if (!is_cacheable(rx_packet.command) || rx_packet.data_length > SESSION_CACHE_REQUEST_LEN) {
+    return NULL;
+  }
+
+  for (uint8_t i = 0; i < cache_count; i++) {
+    cached_answer_t const *answer = &cache[i];
+    if (answer->command == rx_packet.command &&
+        answer->request_len == rx_packet.data_length &&
+        memcmp(answer->request, rx_packet.data, rx_packet.data_length) == 0) {
+      return answer;
+    }
+  }
+
+  return NULL;
+}
+
+bool session_answer_from_cache() {
+  cached_answer_t const *answer = find_answer();
+  if (answer == NULL) {
+    return false;
+  }
+
+  // The whole frame goes out in one go, without building or logging it.
+  pogo_uart_write_blocking(answer->frame, answer->frame_len);
+  trace_record(TRACE_POGO_TX, answer->frame, answer->frame_len);
+  session_stats.cached_answers++;
+  return true;
+}
+
+void session_store_answer() {
+  if (!is_cacheable(rx_packet.command) || rx_packet.data_length > SESSION_CACHE_REQUEST_LEN ||
+      tx_packet.command != rx_packet.command || find_answer() != NULL ||
+      cache_count >= SESSION_CACHE_ENTRIES) {
+    return;
+  }
+
+  cached_answer_t *answer = &cache[cache_count++];
+  answer->command = rx_packet.command;
+  answer->request_len = rx_packet.data_length;
+  memcpy(answer->request, rx_packet.data, rx_packet.data_length);
+  answer->frame_len = packet_frame_len(&tx_packet);
+  memcpy(answer->frame, &tx_packet, answer->frame_len);
+}
+
+void session_invalidate() {
+  cache_count = 0;
+}
+
+void session_entered_app() {
+  if (!reconnecting) {
+    return;
+  }
+  reconnecting = false;
+
+  uint32_t took = (uint32_t)absolute_time_diff_us(link_restored, get_absolute_time());
+  session_stats.reconnects++;
+  session_stats.last_reconnect_us = took;
+  if (took > session_stats.max_reconnect_us) {
+    session_stats.max_reconnect_us = took;
+  }
+}
+
+void session_print_stats() {
+  printf("Session: link %s, %lu losses, %lu reconnects, last %lu us max %lu us, %lu cached answers\n",
+    link_up ? "up" : "down", session_stats.link_losses, session_stats.reconnects,
+    session_stats.last_reconnect_us, session_stats.max_reconnect_us,
+    session_stats.cached_answers);
+}
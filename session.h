@@ -0,0 +1,71 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _SESSION_H
+#define _SESSION_H
+
+#include "pico/stdlib.h"
+#include "packet.h"
+
+// Watches the pogo link and remembers our answers to the handshake, so that
+// reattaching to the reMarkable is quick.
+//
+// The link counts as lost when the RX line stays low for SESSION_BREAK_MS
+// (the reMarkable's end is gone or asleep), and as back once it has been idle
+// high for SESSION_IDLE_MS again.
+
+#define SESSION_BREAK_MS 50
+#define SESSION_IDLE_MS 10
+
+// Answers to requests we've seen before. Only the handshake requests are
+// cached, and there are three of them.
+#define SESSION_CACHE_ENTRIES 4
+#define SESSION_CACHE_REQUEST_LEN 16
+
+typedef enum session_event {
+  SESSION_NONE = 0,
+  SESSION_LINK_LOST,
+  SESSION_LINK_RESTORED
+} session_event_t;
+
+typedef struct session_stats {
+  uint32_t link_losses;
+  uint32_t reconnects; // Handshakes finished after the link came back.
+  uint32_t cached_answers;
+  uint32_t last_reconnect_us; // From the link coming back to CMD_ENTER_APP.
+  uint32_t max_reconnect_us;
+} session_stats_t;
+
+extern session_stats_t session_stats;
+
+// Call from the main loop. Tells the caller when the link goes away or comes
+// back.
+session_event_t session_task();
+
+// Sends the cached answer to rx_packet, if there is one, and returns true.
+bool session_answer_from_cache();
+
+// Keeps the answer to rx_packet that rx_handle_command just sent, if it's one
+// of the handshake requests.
+void session_store_answer();
+
+// Forgets all cached answers, e.g. when an attribute changed.
+void session_invalidate();
+
+// Called on CMD_ENTER_APP.
+void session_entered_app();
+
+void session_print_stats();
+
+#endif
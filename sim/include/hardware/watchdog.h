@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Stand-in for the Pico SDK's watchdog. The simulator never reboots, so it
+// always looks like a fresh power on.
+
+#ifndef _SIM_HARDWARE_WATCHDOG_H
+#define _SIM_HARDWARE_WATCHDOG_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+static inline bool watchdog_caused_reboot() {
+  return false;
+}
+
+static inline bool watchdog_enable_caused_reboot() {
+  return false;
+}
+
+#endif
@@ -0,0 +1,104 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Stand-in for the parts of the Pico SDK the adapter uses, for the host
+// simulator. Implemented in sim_hal.c.
+
+#ifndef _SIM_PICO_STDLIB_H
+#define _SIM_PICO_STDLIB_H
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PICO_ERROR_TIMEOUT -1
+
+// Not a build for the RP2040, the SDK's host builds do the same.
+#define PICO_ON_DEVICE 0
+
+// Variables that survive a reboot are just variables.
+#define __uninitialized_ram(name) name
+
+#ifndef MIN
+#define MIN(a, b) ((b) < (a) ? (b) : (a))
+#endif
+
+// Time.
+typedef uint64_t absolute_time_t;
+static const absolute_time_t nil_time = 0;
+
+uint64_t time_us_64();
+uint32_t time_us_32();
+absolute_time_t get_absolute_time();
+int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to);
+void sleep_us(uint64_t us);
+void sleep_ms(uint32_t ms);
+
+static inline uint64_t to_us_since_boot(absolute_time_t t) {
+  return t;
+}
+
+static inline absolute_time_t make_timeout_time_ms(uint32_t ms) {
+  return get_absolute_time() + (uint64_t)ms * 1000;
+}
+
+// Alarms. The callbacks run on a thread of their own, which stands in for the
+// timer interrupt. Repeating alarms aren't supported, the return value of the
+// callback is ignored.
+typedef int32_t alarm_id_t;
+typedef int64_t (*alarm_callback_t)(alarm_id_t id, void *user_data);
+
+alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback, void *user_data, bool fire_if_past);
+bool cancel_alarm(alarm_id_t alarm_id);
+
+// Debug console. The simulator feeds characters into it with
+// sim_console_push.
+void stdio_uart_init();
+int getchar_timeout_us(uint32_t timeout_us);
+
+// Prints the message and exits.
+void panic(const char *fmt, ...);
+
+// GPIO.
+enum gpio_function {
+  GPIO_FUNC_UART = 2
+};
+
+static inline void gpio_set_function(unsigned int gpio, enum gpio_function fn) {
+  (void)gpio;
+  (void)fn;
+}
+
+// Only the pogo RX pin is modelled, see sim_pogo_set_line. Everything else
+// reads high.
+bool gpio_get(unsigned int gpio);
+
+// UART. uart1 is the pogo line and backed by a pseudo terminal.
+typedef struct uart_inst {
+  int fd;
+} uart_inst_t;
+
+extern uart_inst_t sim_uart1;
+#define uart1 (&sim_uart1)
+
+unsigned int uart_init(uart_inst_t *uart, unsigned int baudrate);
+bool uart_is_readable(uart_inst_t *uart);
+char uart_getc(uart_inst_t *uart);
+void uart_putc(uart_inst_t *uart, char c);
+void uart_write_blocking(uart_inst_t *uart, const uint8_t *src, size_t len);
+void uart_tx_wait_blocking(uart_inst_t *uart);
+unsigned int uart_set_baudrate(uart_inst_t *uart, unsigned int baudrate);
+
+#endif
@@ -0,0 +1,234 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Stand-in for the parts of TinyUSB the adapter uses, for the host
+// simulator. Values are the same as in TinyUSB's src/class/hid/hid.h.
+// Implemented in sim_usb.c.
+
+#ifndef _SIM_TUSB_H
+#define _SIM_TUSB_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "tusb_config.h"
+
+#define TU_ATTR_PACKED __attribute__((packed))
+
+typedef enum {
+  TUSB_XFER_CONTROL = 0,
+  TUSB_XFER_ISOCHRONOUS,
+  TUSB_XFER_BULK,
+  TUSB_XFER_INTERRUPT
+} tusb_xfer_type_t;
+
+typedef enum {
+  TUSB_DIR_OUT = 0,
+  TUSB_DIR_IN = 1
+} tusb_dir_t;
+
+typedef struct TU_ATTR_PACKED {
+  uint8_t bLength;
+  uint8_t bDescriptorType;
+  uint8_t bEndpointAddress;
+  struct TU_ATTR_PACKED {
+    uint8_t xfer : 2;
+    uint8_t sync : 2;
+    uint8_t usage : 2;
+    uint8_t : 2;
+  } bmAttributes;
+  uint16_t wMaxPacketSize;
+  uint8_t bInterval;
+} tusb_desc_endpoint_t;
+
+static inline tusb_dir_t tu_edpt_dir(uint8_t addr) {
+  return (addr & 0x80) ? TUSB_DIR_IN : TUSB_DIR_OUT;
+}
+
+typedef enum {
+  XFER_RESULT_SUCCESS = 0,
+  XFER_RESULT_FAILED,
+  XFER_RESULT_STALLED,
+  XFER_RESULT_TIMEOUT,
+  XFER_RESULT_INVALID
+} xfer_result_t;
+
+enum {
+  TUSB_REQ_RCPT_DEVICE = 0,
+  TUSB_REQ_TYPE_STANDARD = 0,
+  TUSB_REQ_SET_FEATURE = 0x03,
+  TUSB_REQ_FEATURE_REMOTE_WAKEUP = 1
+};
+
+#define TUSB_DESC_CONFIG_ATT_REMOTE_WAKEUP (1 << 5)
+
+typedef struct TU_ATTR_PACKED {
+  union {
+    struct TU_ATTR_PACKED {
+      uint8_t recipient : 5;
+      uint8_t type : 2;
+      uint8_t direction : 1;
+    } bmRequestType_bit;
+    uint8_t bmRequestType;
+  };
+  uint8_t bRequest;
+  uint16_t wValue;
+  uint16_t wIndex;
+  uint16_t wLength;
+} tusb_control_request_t;
+
+typedef struct TU_ATTR_PACKED {
+  uint8_t bLength;
+  uint8_t bDescriptorType;
+  uint16_t wTotalLength;
+  uint8_t bNumInterfaces;
+  uint8_t bConfigurationValue;
+  uint8_t iConfiguration;
+  uint8_t bmAttributes;
+  uint8_t bMaxPower;
+} tusb_desc_configuration_t;
+
+struct tuh_xfer_s;
+typedef struct tuh_xfer_s tuh_xfer_t;
+typedef void (*tuh_xfer_cb_t)(tuh_xfer_t *xfer);
+
+struct tuh_xfer_s {
+  uint8_t daddr;
+  uint8_t ep_addr;
+  xfer_result_t result;
+  uint32_t actual_len;
+  tusb_control_request_t const *setup;
+  uint8_t *buffer;
+  tuh_xfer_cb_t complete_cb;
+  uintptr_t user_data;
+};
+
+typedef struct TU_ATTR_PACKED {
+  uint8_t modifier;
+  uint8_t reserved;
+  uint8_t keycode[6];
+} hid_keyboard_report_t;
+
+typedef struct {
+  uint8_t report_id;
+  uint8_t usage;
+  uint16_t usage_page;
+} tuh_hid_report_info_t;
+
+#define HID_USAGE_PAGE_DESKTOP 0x01
+#define HID_USAGE_DESKTOP_KEYBOARD 0x06
+
+#define KEYBOARD_MODIFIER_LEFTCTRL (1 << 0)
+#define KEYBOARD_MODIFIER_LEFTSHIFT (1 << 1)
+#define KEYBOARD_MODIFIER_LEFTALT (1 << 2)
+#define KEYBOARD_MODIFIER_LEFTGUI (1 << 3)
+#define KEYBOARD_MODIFIER_RIGHTCTRL (1 << 4)
+#define KEYBOARD_MODIFIER_RIGHTSHIFT (1 << 5)
+#define KEYBOARD_MODIFIER_RIGHTALT (1 << 6)
+#define KEYBOARD_MODIFIER_RIGHTGUI (1 << 7)
+
+#define HID_KEY_NONE 0x00
+#define HID_KEY_A 0x04
+#define HID_KEY_B 0x05
+#define HID_KEY_C 0x06
+#define HID_KEY_D 0x07
+#define HID_KEY_E 0x08
+#define HID_KEY_F 0x09
+#define HID_KEY_G 0x0A
+#define HID_KEY_H 0x0B
+#define HID_KEY_I 0x0C
+#define HID_KEY_J 0x0D
+#define HID_KEY_K 0x0E
+#define HID_KEY_L 0x0F
+#define HID_KEY_M 0x10
+#define HID_KEY_N 0x11
+#define HID_KEY_O 0x12
+#define HID_KEY_P 0x13
+#define HID_KEY_Q 0x14
+#define HID_KEY_R 0x15
+#define HID_KEY_S 0x16
+#define HID_KEY_T 0x17
+#define HID_KEY_U 0x18
+#define HID_KEY_V 0x19
+#define HID_KEY_W 0x1A
+#define HID_KEY_X 0x1B
+#define HID_KEY_Y 0x1C
+#define HID_KEY_Z 0x1D
+#define HID_KEY_1 0x1E
+#define HID_KEY_2 0x1F
+#define HID_KEY_3 0x20
+#define HID_KEY_4 0x21
+#define HID_KEY_5 0x22
+#define HID_KEY_6 0x23
+#define HID_KEY_7 0x24
+#define HID_KEY_8 0x25
+#define HID_KEY_9 0x26
+#define HID_KEY_0 0x27
+#define HID_KEY_ENTER 0x28
+#define HID_KEY_ESCAPE 0x29
+#define HID_KEY_BACKSPACE 0x2A
+#define HID_KEY_TAB 0x2B
+#define HID_KEY_SPACE 0x2C
+#define HID_KEY_MINUS 0x2D
+#define HID_KEY_EQUAL 0x2E
+#define HID_KEY_BRACKET_LEFT 0x2F
+#define HID_KEY_BRACKET_RIGHT 0x30
+#define HID_KEY_BACKSLASH 0x31
+#define HID_KEY_EUROPE_1 0x32
+#define HID_KEY_SEMICOLON 0x33
+#define HID_KEY_APOSTROPHE 0x34
+#define HID_KEY_GRAVE 0x35
+#define HID_KEY_COMMA 0x36
+#define HID_KEY_PERIOD 0x37
+#define HID_KEY_SLASH 0x38
+#define HID_KEY_CAPS_LOCK 0x39
+#define HID_KEY_HOME 0x4A
+#define HID_KEY_PAGE_UP 0x4B
+#define HID_KEY_DELETE 0x4C
+#define HID_KEY_END 0x4D
+#define HID_KEY_PAGE_DOWN 0x4E
+#define HID_KEY_ARROW_RIGHT 0x4F
+#define HID_KEY_ARROW_LEFT 0x50
+#define HID_KEY_ARROW_DOWN 0x51
+#define HID_KEY_ARROW_UP 0x52
+#define HID_KEY_CONTROL_LEFT 0xE0
+#define HID_KEY_SHIFT_LEFT 0xE1
+#define HID_KEY_ALT_LEFT 0xE2
+#define HID_KEY_GUI_LEFT 0xE3
+#define HID_KEY_CONTROL_RIGHT 0xE4
+#define HID_KEY_SHIFT_RIGHT 0xE5
+#define HID_KEY_ALT_RIGHT 0xE6
+#define HID_KEY_GUI_RIGHT 0xE7
+
+bool tusb_init();
+bool tuh_inited();
+void tuh_task();
+// Waits up to timeout_ms for a report to be injected before running tuh_task.
+void tuh_task_ext(uint32_t timeout_ms, bool in_isr);
+
+bool tuh_vid_pid_get(uint8_t dev_addr, uint16_t *vid, uint16_t *pid);
+bool tuh_descriptor_get_configuration(uint8_t daddr, uint8_t index, void *buffer, uint16_t len,
+  tuh_xfer_cb_t complete_cb, uintptr_t user_data);
+bool tuh_control_xfer(tuh_xfer_t *xfer);
+uint8_t tuh_hid_parse_report_descriptor(tuh_hid_report_info_t *report_info_arr, uint8_t arr_count,
+  uint8_t const *desc_report, uint16_t desc_len);
+bool tuh_hid_receive_report(uint8_t dev_addr, uint8_t instance);
+
+// Implemented by the application.
+void tuh_mount_cb(uint8_t daddr);
+void tuh_hid_mount_cb(uint8_t dev_addr, uint8_t instance, uint8_t const *desc_report, uint16_t desc_len);
+void tuh_hid_umount_cb(uint8_t dev_addr, uint8_t instance);
+void tuh_hid_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t const *report, uint16_t len);
+
+#endif
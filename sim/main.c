@@ -0,0 +1,705 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Runs the adapter against a virtual reMarkable and a virtual keyboard,
+// types a scripted workload and reports handshake time, key latency and
+// dropped events.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "app.h"
+#include "packet.h"
+#include "rm_keyboard.h"
+#include "session.h"
+#include "tap_hold.h"
+#include "clock_scaling.h"
+#include "sim.h"
+#include "peer.h"
+#include "trace.h"
+#include "trace_file.h"
+
+typedef struct workload {
+  const char *text;
+  int repeat;
+  uint32_t interval_us; // Between two reports.
+  int rollover; // Number of keys held down at the same time.
+  bool tap_hold; // Start words with Caps Lock taps and Caps Lock chords.
+} workload_t;
+
+// Every key event we expect the adapter to forward, in the order the reports
+// were injected.
+typedef struct expected_event {
+  uint8_t code;
+  uint64_t injected_us;
+  uint64_t delivered_us;
+  bool matched;
+} expected_event_t;
+
+#define MAX_EXPECTED 65536
+static expected_event_t expected[MAX_EXPECTED];
+static uint32_t expected_count, first_unmatched;
+
+static uint32_t latencies[MAX_EXPECTED];
+static uint32_t latency_count;
+static uint32_t unexpected_keys;
+
+static FILE *out;
+
+// Time from pressing the key that wakes the suspended adapter until the
+// reMarkable receives it, including the handshake.
+static bool suspend_tested = false;
+static uint64_t wake_key_us = 0;
+
+// What the reMarkable received since sync_log_len was last reset, in order.
+#define SYNC_LOG_LEN 16
+static uint8_t sync_log[SYNC_LOG_LEN];
+static uint8_t sync_log_len;
+
+static void on_key(uint8_t code, uint64_t time_us) {
+  if (sync_log_len < SYNC_LOG_LEN) {
+    sync_log[sync_log_len++] = code;
+  }
+
+  for (uint32_t i = first_unmatched; i < expected_count; i++) {
+    if (!expected[i].matched && expected[i].code == code) {
+      expected[i].matched = true;
+      expected[i].delivered_us = time_us;
+      latencies[latency_count++] = (uint32_t)(time_us - expected[i].injected_us);
+      while (first_unmatched < expected_count && expected[first_unmatched].matched) {
+        first_unmatched++;
+      }
+      return;
+    }
+  }
+  unexpected_keys++;
+}
+
+static void expect(uint8_t hid_key, bool down, uint64_t now) {
+  uint8_t rm_code = keycodes[hid_key];
+  if (rm_code == KEYCODE_INVALID || expected_count >= MAX_EXPECTED) {
+    return;
+  }
+  expected[expected_count++] = (expected_event_t){
+    .code = rm_code | (down ? 1 : 0),
+    .injected_us = now
+  };
+}
+
+static bool report_has_key(hid_keyboard_report_t const *report, uint8_t key) {
+  for (int i = 0; i < 6; i++) {
+    if (report->keycode[i] == key) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Records the key events a keyboard report should turn into. This mirrors the
+// diffing in usb_process_keyboard_report.
+static void expect_report(hid_keyboard_report_t const *report) {
+  static hid_keyboard_report_t prev = {0, 0, {0}};
+  uint64_t now = time_us_64();
+
+  for (int i = 0; i < 6; i++) {
+    if (report->keycode[i] != 0 && !report_has_key(&prev, report->keycode[i])) {
+      expect(report->keycode[i], true, now);
+    }
+  }
+  for (int i = 0; i < 6; i++) {
+    if (prev.keycode[i] != 0 && !report_has_key(report, prev.keycode[i])) {
+      expect(prev.keycode[i], false, now);
+    }
+  }
+  static struct { uint8_t mask; uint8_t key; } const modifiers[] = {
+    { KEYBOARD_MODIFIER_LEFTCTRL | KEYBOARD_MODIFIER_RIGHTCTRL, HID_KEY_CONTROL_LEFT },
+    { KEYBOARD_MODIFIER_LEFTSHIFT | KEYBOARD_MODIFIER_RIGHTSHIFT, HID_KEY_SHIFT_LEFT },
+    { KEYBOARD_MODIFIER_LEFTALT | KEYBOARD_MODIFIER_RIGHTALT, HID_KEY_ALT_LEFT }
+  };
+  for (int i = 0; i < 3; i++) {
+    bool down = report->modifier & modifiers[i].mask;
+    if (down != (bool)(prev.modifier & modifiers[i].mask)) {
+      expect(modifiers[i].key, down, now);
+    }
+  }
+
+  prev = *report;
+}
+
+static void inject(hid_keyboard_report_t const *report) {
+  expect_report(report);
+  while (!sim_hid_inject(report)) {
+    peer_poll(100);
+  }
+}
+
+static uint8_t char_to_key(char c, bool *shift) {
+  *shift = false;
+  if (c >= 'a' && c <= 'z') {
+    return HID_KEY_A + (c - 'a');
+  }
+  if (c >= 'A' && c <= 'Z') {
+    *shift = true;
+    return HID_KEY_A + (c - 'A');
+  }
+  if (c >= '1' && c <= '9') {
+    return HID_KEY_1 + (c - '1');
+  }
+
+  switch (c) {
+    case '0': return HID_KEY_0;
+    case ' ': return HID_KEY_SPACE;
+    case '\n': return HID_KEY_ENTER;
+    case '.': return HID_KEY_PERIOD;
+    case ',': return HID_KEY_COMMA;
+    case '/': return HID_KEY_SLASH;
+    case ';': return HID_KEY_SEMICOLON;
+    case '\'': return HID_KEY_APOSTROPHE;
+    case '=': return HID_KEY_EQUAL;
+    case '\\': return HID_KEY_BACKSLASH;
+    case '`': return HID_KEY_GRAVE;
+    default: return HID_KEY_NONE;
+  }
+}
+
+// Waits until it's time for the next report while servicing the pogo line.
+static void wait_until(uint64_t time_us) {
+  uint64_t now;
+  while ((now = time_us_64()) < time_us) {
+    peer_poll(time_us - now);
+  }
+}
+
+// Injects a report without deriving the expected events from it, for reports
+// the adapter doesn't map 1:1. The previous report has to be empty, and the
+// last one injected this way as well.
+static void inject_as_is(hid_keyboard_report_t const *report) {
+  while (!sim_hid_inject(report)) {
+    peer_poll(100);
+  }
+}
+
+// Presses Caps Lock either on its own, which the adapter sends as Caps Lock
+// once it's released, or with key, which turns it into Ctrl as soon as key
+// goes down. Held on its own for longer than the tapping term, it's Ctrl as
+// well. The expected events are timed from pressing Caps Lock, so the latency
+// includes the adapter's decision.
+static void type_tap_hold(uint8_t key, uint64_t *next, uint32_t interval_us) {
+  hid_keyboard_report_t report = { 0, 0, { HID_KEY_CAPS_LOCK } };
+  bool hold = key != HID_KEY_NONE || interval_us >= RMK_TAP_HOLD_MS * 1000;
+  wait_until(*next);
+  uint64_t pressed = time_us_64();
+  if (hold) {
+    expect(HID_KEY_CONTROL_LEFT, true, pressed);
+  }
+  inject_as_is(&report);
+  *next += interval_us;
+
+  if (key != HID_KEY_NONE) {
+    report.keycode[1] = key;
+    wait_until(*next);
+    expect(key, true, time_us_64());
+    inject_as_is(&report);
+    *next += interval_us;
+
+    report.keycode[1] = 0;
+    wait_until(*next);
+    expect(key, false, time_us_64());
+    inject_as_is(&report);
+    *next += interval_us;
+  }
+
+  memset(&report, 0, sizeof(report));
+  wait_until(*next);
+  if (hold) {
+    expect(HID_KEY_CONTROL_LEFT, false, time_us_64());
+  } else {
+    expect(HID_KEY_CAPS_LOCK, true, pressed);
+    expect(HID_KEY_CAPS_LOCK, false, pressed);
+  }
+  inject_as_is(&report);
+  *next += interval_us;
+}
+
+static void run_workload(workload_t const *workload) {
+  hid_keyboard_report_t report;
+  uint64_t next = time_us_64();
+  uint32_t words = 0;
+
+  for (int r = 0; r < workload->repeat; r++) {
+    for (const char *p = workload->text; *p; p++) {
+      bool shift;
+      uint8_t key = char_to_key(*p, &shift);
+      if (key == HID_KEY_NONE) {
+        continue;
+      }
+
+      bool word_start = p == workload->text || p[-1] == ' ' || p[-1] == '\n';
+      if (workload->tap_hold && workload->rollover <= 1 && word_start && key != HID_KEY_SPACE) {
+        // Caps Lock tapped before even words, held with the first key of odd
+        // ones.
+        if (words++ % 2 == 1) {
+          type_tap_hold(key, &next, workload->interval_us);
+          continue;
+        }
+        type_tap_hold(HID_KEY_NONE, &next, workload->interval_us);
+      }
+
+      if (workload->rollover <= 1) {
+        // Press and release.
+        memset(&report, 0, sizeof(report));
+        report.modifier = shift ? KEYBOARD_MODIFIER_LEFTSHIFT : 0;
+        report.keycode[0] = key;
+        wait_until(next);
+        inject(&report);
+        next += workload->interval_us;
+
+        memset(&report, 0, sizeof(report));
+        wait_until(next);
+        inject(&report);
+        next += workload->interval_us;
+      } else {
+        // Keep the last few keys held down, the oldest one is released when
+        // the new one goes down.
+        if (report_has_key(&report, key)) {
+          continue;
+        }
+        int held = 0;
+        while (held < 6 && report.keycode[held] != 0) {
+          held++;
+        }
+        if (held >= workload->rollover || held >= 6) {
+          memmove(report.keycode, report.keycode + 1, 5);
+          report.keycode[5] = 0;
+          held--;
+        }
+        report.keycode[held] = key;
+        wait_until(next);
+        inject(&report);
+        next += workload->interval_us;
+      }
+    }
+  }
+
+  memset(&report, 0, sizeof(report));
+  wait_until(next);
+  inject(&report);
+}
+
+// Suspends the adapter, then presses a key that has to wake it up, the
+// reMarkable along with it, and still arrive.
+static bool run_suspend() {
+  if (!peer_suspend(1000)) {
+    return false;
+  }
+  sleep_ms(50);
+
+  uint32_t wake_event = expected_count;
+  hid_keyboard_report_t report = { 0, 0, { HID_KEY_A } };
+  inject(&report);
+  if (!peer_handshake(2000)) {
+    return false;
+  }
+
+  memset(&report, 0, sizeof(report));
+  inject(&report);
+  peer_poll(100000);
+
+  suspend_tested = true;
+  if (expected[wake_event].matched) {
+    wake_key_us = expected[wake_event].delivered_us - expected[wake_event].injected_us;
+  }
+  return expected[wake_event].matched;
+}
+
+// Detaches the virtual reMarkable by holding the line low and attaches it
+// again, which has to end in a new handshake. The keyboard changes to the
+// given report while it's away, the adapter has to catch up right after the
+// handshake.
+static bool reconnect_tested = false;
+static uint64_t reconnect_us = 0;
+
+static bool reattach_with(hid_keyboard_report_t const *report) {
+  sim_pogo_set_line(false);
+  sleep_ms(SESSION_BREAK_MS + 10);
+  inject(report);
+  sleep_ms(SESSION_BREAK_MS);
+
+  sync_log_len = 0;
+  uint64_t start = time_us_64();
+  sim_pogo_set_line(true);
+  if (!peer_handshake(2000)) {
+    return false;
+  }
+
+  reconnect_us = time_us_64() - start;
+  peer_poll(20000);
+  return true;
+}
+
+// Where the event is in sync_log, -1 if it's not there.
+static int synced_at(uint8_t hid_key, bool down) {
+  uint8_t code = keycodes[hid_key] | (down ? 1 : 0);
+  for (int i = 0; i < sync_log_len; i++) {
+    if (sync_log[i] == code) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// Two rounds. First Shift and A are held when the line goes, and A is
+// released and B pressed while it's away: the adapter has to release A, then
+// press B, and nothing else. Then only A is held, and Shift and B are pressed
+// while it's away: A has to go up first, and Shift down before B, or the
+// reMarkable would see a lower case b.
+static bool run_reconnect() {
+  hid_keyboard_report_t report = { KEYBOARD_MODIFIER_LEFTSHIFT, 0, { HID_KEY_A } };
+  inject(&report);
+  peer_poll(20000);
+
+  report.keycode[0] = HID_KEY_B;
+  if (!reattach_with(&report)) {
+    return false;
+  }
+  int a_up = synced_at(HID_KEY_A, false), b_down = synced_at(HID_KEY_B, true);
+  if (sync_log_len != 2 || a_up != 0 || b_down != 1) {
+    fprintf(out, "Keys synced wrong after reattaching with B instead of A held\n");
+    return false;
+  }
+
+  memset(&report, 0, sizeof(report));
+  inject(&report);
+  report.keycode[0] = HID_KEY_A;
+  inject(&report);
+  peer_poll(20000);
+
+  report = (hid_keyboard_report_t){ KEYBOARD_MODIFIER_LEFTSHIFT, 0, { HID_KEY_B } };
+  if (!reattach_with(&report)) {
+    return false;
+  }
+  a_up = synced_at(HID_KEY_A, false);
+  int shift_down = synced_at(HID_KEY_SHIFT_LEFT, true);
+  b_down = synced_at(HID_KEY_B, true);
+  if (sync_log_len != 3 || a_up != 0 || shift_down != 1 || b_down != 2) {
+    fprintf(out, "Keys synced wrong after reattaching with Shift and B instead of A held\n");
+    return false;
+  }
+
+  memset(&report, 0, sizeof(report));
+  inject(&report);
+  peer_poll(20000);
+
+  reconnect_tested = true;
+  return true;
+}
+
+// The report layout from the trace's TRACE_HID_MOUNT record.
+static tuh_hid_report_info_t trace_layout[4];
+static uint8_t trace_layout_count = 0;
+
+static bool find_trace_layout(trace_file_t const *trace) {
+  trace_file_cursor_t cursor;
+  trace_entry_t entry;
+  bool malformed;
+
+  trace_file_rewind(trace, &cursor);
+  while (trace_file_next(trace, &cursor, &entry, &malformed)) {
+    if (entry.type != TRACE_HID_MOUNT || entry.len < 3) {
+      continue;
+    }
+    trace_layout_count = entry.data[2] < 4 ? entry.data[2] : 4;
+    for (uint8_t i = 0; i < trace_layout_count && 3 + 4 * i + 3 < entry.len; i++) {
+      uint8_t const *info = entry.data + 3 + 4 * i;
+      trace_layout[i].report_id = info[0];
+      trace_layout[i].usage = info[1];
+      trace_layout[i].usage_page = info[2] | (info[3] << 8);
+    }
+    return true;
+  }
+
+  return false;
+}
+
+// Finds the keyboard report in a raw report, the same way
+// usb_handle_hid_report does.
+static bool keyboard_report(uint8_t const *raw, uint16_t len, hid_keyboard_report_t *report) {
+  tuh_hid_report_info_t const *info = NULL;
+
+  if (trace_layout_count == 1 && trace_layout[0].report_id == 0) {
+    info = &trace_layout[0];
+  } else if (len > 0) {
+    for (uint8_t i = 0; i < trace_layout_count; i++) {
+      if (trace_layout[i].report_id == raw[0]) {
+        info = &trace_layout[i];
+      }
+    }
+    raw++;
+    len--;
+  }
+
+  if (info == NULL || info->usage_page != HID_USAGE_PAGE_DESKTOP ||
+      info->usage != HID_USAGE_DESKTOP_KEYBOARD) {
+    return false;
+  }
+
+  memset(report, 0, sizeof(*report));
+  memcpy(report, raw, len < sizeof(*report) ? len : sizeof(*report));
+  return true;
+}
+
+// Injects the HID reports of a captured trace, either with their original
+// spacing or, with full_speed, one after the other.
+static bool run_trace(trace_file_t const *trace, bool full_speed) {
+  trace_file_cursor_t cursor;
+  trace_entry_t entry;
+  bool malformed;
+  bool have_first = false;
+  uint32_t first_time = 0;
+  uint64_t start = time_us_64();
+
+  trace_file_rewind(trace, &cursor);
+  while (trace_file_next(trace, &cursor, &entry, &malformed)) {
+    if (entry.type != TRACE_HID_REPORT || entry.len <= 2) {
+      continue;
+    }
+
+    if (!have_first) {
+      first_time = entry.time;
+      have_first = true;
+    }
+    if (!full_speed) {
+      wait_until(start + (uint32_t)(entry.time - first_time));
+    }
+
+    hid_keyboard_report_t report;
+    if (keyboard_report(entry.data + 2, entry.len - 2, &report)) {
+      expect_report(&report);
+    }
+    while (!sim_hid_inject_raw(entry.data + 2, entry.len - 2)) {
+      peer_poll(100);
+    }
+  }
+
+  return !malformed;
+}
+
+static int compare_u32(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+static uint32_t percentile(uint32_t p) {
+  if (latency_count == 0) {
+    return 0;
+  }
+  uint32_t ix = (latency_count * p + 99) / 100;
+  return latencies[ix > 0 ? ix - 1 : 0];
+}
+
+static void print_report() {
+  qsort(latencies, latency_count, sizeof(latencies[0]), compare_u32);
+
+  fprintf(out, "Handshake:   %.2f ms\n", peer_stats.handshake_us / 1000.0);
+  fprintf(out, "Key events:  %u expected, %u forwarded, %u dropped, %u unexpected\n",
+    expected_count, latency_count, expected_count - latency_count, unexpected_keys);
+  fprintf(out, "Key latency: p50 %u us, p99 %u us, max %u us\n",
+    percentile(50), percentile(99), latency_count ? latencies[latency_count - 1] : 0);
+  fprintf(out, "Keep-alive:  %u received, max gap %.1f ms, %u timeouts\n",
+    peer_stats.keep_alives, peer_stats.max_keep_alive_gap_us / 1000.0,
+    peer_stats.keep_alive_timeouts);
+  fprintf(out, "Frames:      %u received, %u checksum errors\n",
+    peer_stats.frames_received, peer_stats.checksum_errors);
+  fprintf(out, "Resync:      %u bad frames, %u salvaged, max recovery %u us\n",
+    rx_stats.checksum_errors + rx_stats.invalid_frames, rx_stats.frames_salvaged,
+    rx_stats.max_recovery_us);
+  fprintf(out, "Key queue:   %u queued, %u dropped when full, max depth %u\n",
+    app_stats.key_events_queued, app_stats.key_events_dropped, app_stats.max_queue_depth);
+  fprintf(out, "Queue to TX: max %u us in the adapter\n", app_stats.max_key_latency_us);
+  // Without batching, every frame would have been a write of its own. Key
+  // frames can't share a header, the report format has one key per frame.
+  fprintf(out, "TX writes:   %u frames, %u writes on the line, %u saved by batching, up to %u frames "
+    "per write, %u header bytes\n", tx_stats.frames, sim_pogo_writes, tx_stats.frames - tx_stats.writes,
+    tx_stats.max_batch_frames, tx_stats.frames * PACKET_OVERHEAD);
+  if (reconnect_tested) {
+    fprintf(out, "Reconnect:   %.2f ms to reattach, handshake %.2f ms, %u cached answers, "
+      "%u keys synced\n", reconnect_us / 1000.0, peer_stats.handshake_us / 1000.0,
+      session_stats.cached_answers, app_stats.keys_synced);
+  }
+  if (tap_hold_stats.taps + tap_hold_stats.holds > 0) {
+    uint32_t decisions = tap_hold_stats.taps + tap_hold_stats.holds;
+    fprintf(out, "Tap-hold:    %u taps, %u holds (%u by another key), decision avg %u us, max %u us\n",
+      tap_hold_stats.taps, tap_hold_stats.holds, tap_hold_stats.holds_by_key,
+      (uint32_t)(tap_hold_stats.total_decision_us / decisions), tap_hold_stats.max_decision_us);
+  }
+  uint32_t average_ua = clock_scaling_average_ua();
+  uint64_t total_us = 0;
+  for (int i = 0; i < POWER_CLOCKS; i++) {
+    total_us += clock_scaling_stats.residency_us[i];
+  }
+  fprintf(out, "Clock:       %.1f%% idle, %.1f%% suspended, %u boosts, boost max %u us, "
+    "about %.1f mA\n", clock_scaling_stats.residency_us[POWER_CLOCK_IDLE] * 100.0 / total_us,
+    clock_scaling_stats.residency_us[POWER_CLOCK_SUSPEND] * 100.0 / total_us,
+    clock_scaling_stats.boosts, clock_scaling_stats.max_boost_us, average_ua / 1000.0);
+  if (suspend_tested) {
+    fprintf(out, "Suspend:     wake key arrived after %.2f ms, adapter resume to first key %u us\n",
+      wake_key_us / 1000.0, app_stats.last_resume_to_key_us);
+  }
+}
+
+static void file_writer(uint8_t const *data, size_t len, void *ctx) {
+  fwrite(data, 1, len, (FILE *)ctx);
+}
+
+static void *app_thread(void *arg) {
+  app_main();
+  return NULL;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr,
+    "Usage: %s [options]\n"
+    "  -t TEXT  Text to type (default: a pangram)\n"
+    "  -n N     Type the text N times (default: 5)\n"
+    "  -i MS    Milliseconds between two HID reports (default: 10)\n"
+    "  -r N     Hold up to N keys at once (default: 1, no rollover)\n"
+    "  -C       Tap Caps Lock before every other word, hold it with the first key of the rest\n"
+    "  -H FILE  Replay the HID reports from a captured trace instead of typing\n"
+    "  -F       Replay the HID reports at full speed instead of original timing\n"
+    "  -N       Put a bogus frame header in front of every frame to the adapter\n"
+    "  -D       Detach and reattach the reMarkable first\n"
+    "  -S       Suspend the adapter and wake it up with a key press first\n"
+    "  -T FILE  Capture the pogo traffic and HID reports into FILE\n"
+    "  -v       Show the adapter's log output\n", name);
+}
+
+int main(int argc, char **argv) {
+  workload_t workload = {
+    .text = "The quick brown fox jumps over the lazy dog 0123456789.\n",
+    .repeat = 5,
+    .interval_us = 10000,
+    .rollover = 1
+  };
+  bool verbose = false;
+  const char *trace_file = NULL;
+  const char *hid_trace_file = NULL;
+  bool full_speed = false;
+  bool suspend = false;
+  bool reconnect = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "t:n:i:r:CH:FNDST:vh")) != -1) {
+    switch (opt) {
+      case 't': workload.text = optarg; break;
+      case 'n': workload.repeat = atoi(optarg); break;
+      case 'i': workload.interval_us = (uint32_t)(atof(optarg) * 1000); break;
+      case 'r': workload.rollover = atoi(optarg); break;
+      case 'C': workload.tap_hold = true; break;
+      case 'H': hid_trace_file = optarg; break;
+      case 'F': full_speed = true; break;
+      case 'N': peer_set_noise(true); break;
+      case 'D': reconnect = true; break;
+      case 'S': suspend = true; break;
+      case 'T': trace_file = optarg; break;
+      case 'v': verbose = true; break;
+      default: usage(argv[0]); return 2;
+    }
+  }
+
+  // The adapter logs to stdout, the report goes to the original stdout.
+  out = fdopen(dup(STDOUT_FILENO), "w");
+  setvbuf(out, NULL, _IOLBF, 0);
+  if (!verbose) {
+    freopen("/dev/null", "w", stdout);
+  }
+
+  trace_file_t hid_trace;
+  if (hid_trace_file != NULL) {
+    if (!trace_file_load(hid_trace_file, &hid_trace)) {
+      return 1;
+    }
+    if (find_trace_layout(&hid_trace)) {
+      sim_usb_set_layout(trace_layout, trace_layout_count);
+    } else {
+      // No layout in the trace, assume a boot keyboard.
+      trace_layout[0] = (tuh_hid_report_info_t){ 0, HID_USAGE_DESKTOP_KEYBOARD, HID_USAGE_PAGE_DESKTOP };
+      trace_layout_count = 1;
+    }
+  }
+
+  if (trace_file != NULL) {
+    trace_start();
+  }
+
+  int pogo_fd = sim_pogo_open();
+  peer_init(pogo_fd, on_key);
+
+  pthread_t thread;
+  pthread_create(&thread, NULL, app_thread, NULL);
+
+  sim_usb_plug();
+  while (!sim_usb_mounted()) {
+    sleep_ms(1);
+  }
+
+  // Same as typing '.' on the debug console.
+  sim_console_push('.');
+  if (!peer_handshake(2000)) {
+    fprintf(out, "Handshake failed\n");
+    return 1;
+  }
+
+  if (reconnect && !run_reconnect()) {
+    fprintf(out, "Reconnect failed\n");
+    return 1;
+  }
+
+  if (suspend && !run_suspend()) {
+    fprintf(out, "Resume from suspend failed\n");
+    return 1;
+  }
+
+  if (hid_trace_file != NULL) {
+    if (!run_trace(&hid_trace, full_speed)) {
+      fprintf(out, "Malformed trace\n");
+      return 1;
+    }
+  } else {
+    run_workload(&workload);
+  }
+
+  // Give the adapter time to forward whatever is still queued.
+  peer_poll(500000);
+
+  print_report();
+  fflush(out);
+
+  if (trace_file != NULL) {
+    // The adapter thread is still running, but the line is quiet by now.
+    trace_stop();
+    FILE *f = fopen(trace_file, "wb");
+    if (f == NULL) {
+      perror(trace_file);
+      _exit(1);
+    }
+    trace_serialize(file_writer, f);
+    fclose(f);
+  }
+
+  // The adapter's main loop never returns.
+  _exit(expected_count == latency_count ? 0 : 1);
+}
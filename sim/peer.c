@@ -0,0 +1,358 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pico/stdlib.h"
+#include "packet.h"
+#include "attribute.h"
+#include "peer.h"
+
+// The adapter starts its frames with 0x2e, we start ours with 0x3a.
+#define FRAME_START_RX 0x2e
+#define FRAME_START_TX 0x3a
+#define WAKE_BYTE 0xff
+
+peer_stats_t peer_stats;
+
+static int peer_fd = -1;
+static peer_key_cb_t peer_key_cb = NULL;
+
+// Parser state for frames coming from the adapter.
+static enum { P_IDLE, P_LEN_LOW, P_LEN_HIGH, P_CMD, P_DATA, P_CHECKSUM } parse_state = P_IDLE;
+static uint8_t frame_cmd;
+static uint16_t frame_len, frame_pos;
+static uint8_t frame_sum;
+static uint8_t frame_data[0x10000];
+
+// The last response that isn't a keep-alive or a key report, for the
+// handshake to look at.
+static bool response_ready = false;
+static uint8_t response_cmd;
+static uint16_t response_len;
+static uint8_t response_data[0x10000];
+
+static bool noise = false;
+static uint32_t noise_count = 0;
+
+static bool woken = false;
+static uint64_t last_keep_alive_us = 0;
+
+void peer_init(int fd, peer_key_cb_t key_cb) {
+  peer_fd = fd;
+  peer_key_cb = key_cb;
+  memset(&peer_stats, 0, sizeof(peer_stats));
+}
+
+void peer_send_raw(uint8_t const *data, uint16_t len) {
+  while (len > 0) {
+    ssize_t written = write(peer_fd, data, len);
+    if (written <= 0) {
+      continue;
+    }
+    data += written;
+    len -= written;
+  }
+}
+
+void peer_set_noise(bool enabled) {
+  noise = enabled;
+}
+
+void peer_send_frame(uint8_t command, uint8_t const *data, uint16_t len) {
+  uint8_t frame[5 + 0x10000];
+  uint8_t sum = 0;
+
+  if (noise) {
+    // Alternate between a header with a command that doesn't exist and one
+    // that swallows the start of the real frame and fails its checksum.
+    static uint8_t const bad_command[] = { 0x3a, 0x04, 0x00 };
+    static uint8_t const bad_checksum[] = { 0x3a, 0x02, 0x00, CMD_ATTRIBUTE_READ };
+    if (noise_count++ % 2 == 0) {
+      peer_send_raw(bad_command, sizeof(bad_command));
+    } else {
+      peer_send_raw(bad_checksum, sizeof(bad_checksum));
+    }
+  }
+
+  frame[0] = FRAME_START_TX;
+  frame[1] = len & 0xff;
+  frame[2] = len >> 8;
+  frame[3] = command;
+  memcpy(frame + 4, data, len);
+  for (uint32_t i = 1; i < 4 + (uint32_t)len; i++) {
+    sum += frame[i];
+  }
+  frame[4 + len] = (uint8_t)-sum;
+
+  peer_send_raw(frame, 5 + len);
+}
+
+static void handle_frame(uint64_t now) {
+  peer_stats.frames_received++;
+
+  switch (frame_cmd) {
+    case CMD_REPORT_ALIVE:
+      if (last_keep_alive_us != 0) {
+        uint64_t gap = now - last_keep_alive_us;
+        if (gap > peer_stats.max_keep_alive_gap_us) {
+          peer_stats.max_keep_alive_gap_us = gap;
+        }
+        if (gap > PEER_KEEP_ALIVE_TIMEOUT_US) {
+          peer_stats.keep_alive_timeouts++;
+        }
+      }
+      last_keep_alive_us = now;
+      peer_stats.keep_alives++;
+      break;
+
+    case CMD_REPORT_KEY:
+      peer_stats.key_reports++;
+      if (frame_len >= 1 && peer_key_cb != NULL) {
+        peer_key_cb(frame_data[0], now);
+      }
+      break;
+
+    default:
+      response_cmd = frame_cmd;
+      response_len = frame_len;
+      memcpy(response_data, frame_data, frame_len);
+      response_ready = true;
+      break;
+  }
+}
+
+static void process_byte(uint8_t data, uint64_t now) {
+  switch (parse_state) {
+    case P_IDLE:
+      if (data == FRAME_START_RX) {
+        frame_sum = 0;
+        parse_state = P_LEN_LOW;
+      } else if (data == WAKE_BYTE) {
+        woken = true;
+      }
+      break;
+
+    case P_LEN_LOW:
+      frame_len = data;
+      frame_sum += data;
+      parse_state = P_LEN_HIGH;
+      break;
+
+    case P_LEN_HIGH:
+      frame_len |= (uint16_t)data << 8;
+      frame_sum += data;
+      parse_state = P_CMD;
+      break;
+
+    case P_CMD:
+      frame_cmd = data;
+      frame_sum += data;
+      frame_pos = 0;
+      parse_state = frame_len > 0 ? P_DATA : P_CHECKSUM;
+      break;
+
+    case P_DATA:
+      frame_data[frame_pos++] = data;
+      frame_sum += data;
+      if (frame_pos >= frame_len) {
+        parse_state = P_CHECKSUM;
+      }
+      break;
+
+    case P_CHECKSUM:
+      parse_state = P_IDLE;
+      if ((uint8_t)(frame_sum + data) != 0) {
+        peer_stats.checksum_errors++;
+        break;
+      }
+      handle_frame(now);
+      break;
+  }
+}
+
+void peer_poll(uint64_t timeout_us) {
+  uint64_t deadline = time_us_64() + timeout_us;
+
+  do {
+    uint64_t now = time_us_64();
+    int timeout_ms = now < deadline ? (int)((deadline - now + 999) / 1000) : 0;
+
+    struct pollfd pfd = { .fd = peer_fd, .events = POLLIN };
+    if (poll(&pfd, 1, timeout_ms) <= 0) {
+      continue;
+    }
+
+    uint8_t buffer[256];
+    ssize_t len = read(peer_fd, buffer, sizeof(buffer));
+    now = time_us_64();
+    for (ssize_t i = 0; i < len; i++) {
+      process_byte(buffer[i], now);
+    }
+
+    if (response_ready || woken) {
+      // Let the handshake look at it right away.
+      return;
+    }
+  } while (time_us_64() < deadline);
+}
+
+static bool wait_for_response(uint8_t command, uint64_t deadline) {
+  while (!response_ready && time_us_64() < deadline) {
+    peer_poll(deadline - time_us_64());
+  }
+  if (!response_ready) {
+    fprintf(stderr, "peer: No response to command %02x\n", command);
+    return false;
+  }
+
+  response_ready = false;
+  if (response_cmd != command) {
+    fprintf(stderr, "peer: Expected response %02x, got %02x\n", command, response_cmd);
+    return false;
+  }
+  return true;
+}
+
+static int attribute_value_length(uint8_t type, uint8_t const *data, uint16_t remaining) {
+  switch (type) {
+    case ATTR_TYPE_INT8:
+    case ATTR_TYPE_UINT8:
+    case ATTR_TYPE_BOOL:
+    case ATTR_TYPE_ENUM8:
+      return 1;
+    case ATTR_TYPE_INT16:
+    case ATTR_TYPE_UINT16:
+      return 2;
+    case ATTR_TYPE_INT32:
+    case ATTR_TYPE_UINT32:
+      return 4;
+    case ATTR_TYPE_STRING:
+      return remaining < 1 ? -1 : 1 + data[0];
+    case ATTR_TYPE_ARRAY: {
+      if (remaining < 3) {
+        return -1;
+      }
+      int element = attribute_value_length(data[0], NULL, 0);
+      if (element < 0) {
+        return -1;
+      }
+      return 3 + element * (data[1] | (data[2] << 8));
+    }
+    default:
+      return -1;
+  }
+}
+
+// Checks that the response to an attribute read is well formed and answers
+// every attribute we asked for.
+static bool check_attributes(uint8_t const *requested, uint16_t requested_len) {
+  uint16_t pos = 0;
+  uint16_t answered = 0;
+
+  while (pos < response_len) {
+    if (response_len - pos < ATTR_HEADER_LENGTH) {
+      return false;
+    }
+    uint8_t id = response_data[pos];
+    uint8_t type = response_data[pos + 2];
+    pos += ATTR_HEADER_LENGTH;
+
+    int len = attribute_value_length(type, response_data + pos, response_len - pos);
+    if (len < 0 || pos + len > response_len) {
+      fprintf(stderr, "peer: Malformed attribute %02x\n", id);
+      return false;
+    }
+    pos += len;
+
+    if (answered >= requested_len || requested[answered] != id) {
+      fprintf(stderr, "peer: Unexpected attribute %02x\n", id);
+      return false;
+    }
+    answered++;
+  }
+
+  return answered == requested_len;
+}
+
+bool peer_handshake(uint32_t timeout_ms) {
+  uint64_t deadline = time_us_64() + (uint64_t)timeout_ms * 1000;
+
+  woken = false;
+  response_ready = false;
+  while (!woken && time_us_64() < deadline) {
+    peer_poll(deadline - time_us_64());
+  }
+  if (!woken) {
+    fprintf(stderr, "peer: Adapter never sent the wake byte\n");
+    return false;
+  }
+  woken = false;
+
+  uint64_t start = time_us_64();
+
+  static uint8_t const attrs_device[] = {
+    ATTR_FIRMWARE_VERSION, ATTR_DEVICE_CLASS, ATTR_DEVICE_ID, ATTR_IMAGE_START_ADDRESS
+  };
+  static uint8_t const attrs_keyboard[] = {
+    ATTR_DEVICE_NAME, ATTR_SERIAL_NUMBER, ATTR_KEY_LAYOUT, ATTR_LANGUAGE
+  };
+
+  peer_send_frame(CMD_ATTRIBUTE_READ, attrs_device, sizeof(attrs_device));
+  if (!wait_for_response(CMD_ATTRIBUTE_READ, deadline) ||
+      !check_attributes(attrs_device, sizeof(attrs_device))) {
+    return false;
+  }
+
+  peer_send_frame(CMD_ATTRIBUTE_READ, attrs_keyboard, sizeof(attrs_keyboard));
+  if (!wait_for_response(CMD_ATTRIBUTE_READ, deadline) ||
+      !check_attributes(attrs_keyboard, sizeof(attrs_keyboard))) {
+    return false;
+  }
+
+  peer_send_frame(CMD_GET_AUTH_KEY, NULL, 0);
+  if (!wait_for_response(CMD_GET_AUTH_KEY, deadline)) {
+    return false;
+  }
+  if (response_len < 2 || response_data[response_len - 1] != 0) {
+    fprintf(stderr, "peer: Auth key isn't NULL terminated\n");
+    return false;
+  }
+
+  peer_send_frame(CMD_ENTER_APP, NULL, 0);
+  if (!wait_for_response(CMD_ENTER_APP, deadline)) {
+    return false;
+  }
+
+  peer_stats.handshake_us = time_us_64() - start;
+  last_keep_alive_us = time_us_64();
+  return true;
+}
+
+bool peer_suspend(uint32_t timeout_ms) {
+  uint64_t deadline = time_us_64() + (uint64_t)timeout_ms * 1000;
+
+  response_ready = false;
+  peer_send_frame(CMD_ENTER_SUSPEND, NULL, 0);
+  if (!wait_for_response(CMD_ENTER_SUSPEND, deadline)) {
+    return false;
+  }
+
+  // The adapter doesn't send keep-alives while suspended.
+  last_keep_alive_us = 0;
+  return true;
+}
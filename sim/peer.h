@@ -0,0 +1,69 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _PEER_H
+#define _PEER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// The reMarkable's side of the pogo protocol, as implemented by the rm-pogo
+// driver: waits for the wake byte, reads the attributes and the auth key,
+// enters the app and then watches keep-alives and key reports.
+
+// The driver considers the keyboard gone if it doesn't hear from it for this
+// long.
+#define PEER_KEEP_ALIVE_TIMEOUT_US 1000000
+
+typedef struct peer_stats {
+  uint64_t handshake_us;
+  uint32_t frames_received;
+  uint32_t checksum_errors;
+  uint32_t keep_alives;
+  uint32_t keep_alive_timeouts;
+  uint64_t max_keep_alive_gap_us;
+  uint32_t key_reports;
+} peer_stats_t;
+
+extern peer_stats_t peer_stats;
+
+// Called for every CMD_REPORT_KEY with the first data byte, which is the
+// reMarkable key code with the press flag in bit 0.
+typedef void (*peer_key_cb_t)(uint8_t code, uint64_t time_us);
+
+void peer_init(int fd, peer_key_cb_t key_cb);
+
+// Runs the handshake, starting with waiting for the 0xff wake byte. Returns
+// false if the adapter didn't answer correctly in time.
+bool peer_handshake(uint32_t timeout_ms);
+
+// Sends CMD_ENTER_SUSPEND, like the driver does when the reMarkable goes to
+// sleep, and waits for the answer. After this, the adapter wakes us up with
+// the wake byte again, so peer_handshake has to be run once more.
+bool peer_suspend(uint32_t timeout_ms);
+
+// Processes everything the adapter sends for up to timeout_us.
+void peer_poll(uint64_t timeout_us);
+
+// Sends a frame the way the driver does.
+void peer_send_frame(uint8_t command, uint8_t const *data, uint16_t len);
+
+// Sends raw bytes, e.g. to inject line noise.
+void peer_send_raw(uint8_t const *data, uint16_t len);
+
+// Puts a bogus frame header in front of every frame, to exercise the
+// adapter's resynchronisation.
+void peer_set_noise(bool noise);
+
+#endif
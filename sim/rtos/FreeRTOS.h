@@ -0,0 +1,51 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Stand-in for the parts of the FreeRTOS kernel rtos.c uses, for the
+// simulator's FreeRTOS build. Tasks are host threads, implemented in
+// sim_freertos.c. Priorities and core affinity are ignored, the host
+// scheduler decides who runs.
+
+#ifndef _SIM_FREERTOS_H
+#define _SIM_FREERTOS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+
+#define configMAX_PRIORITIES 32
+#define configTICK_RATE_HZ 1000
+#define tskIDLE_PRIORITY 0
+
+#define portMAX_DELAY ((TickType_t)0xffffffff)
+#define pdMS_TO_TICKS(ms) ((TickType_t)((uint64_t)(ms) * configTICK_RATE_HZ / 1000))
+
+// There are no interrupts to hold off, the critical section is one recursive
+// lock that all tasks and alarm callbacks share.
+void vTaskEnterCritical();
+void vTaskExitCritical();
+#define taskENTER_CRITICAL() vTaskEnterCritical()
+#define taskEXIT_CRITICAL() vTaskExitCritical()
+
+// A notified task runs on its own thread right away.
+#define portYIELD_FROM_ISR(woken) ((void)(woken))
+
+#endif
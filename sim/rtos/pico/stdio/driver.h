@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Stand-in for the Pico SDK's stdio driver interface, for rtos.c. The
+// simulator prints straight to stdout, switching drivers does nothing.
+
+#ifndef _SIM_PICO_STDIO_DRIVER_H
+#define _SIM_PICO_STDIO_DRIVER_H
+
+#include <stdbool.h>
+
+typedef struct stdio_driver {
+  void (*out_chars)(const char *buf, int len);
+  int (*in_chars)(char *buf, int len);
+} stdio_driver_t;
+
+void stdio_set_driver_enabled(stdio_driver_t *driver, bool enabled);
+
+#endif
@@ -0,0 +1,24 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Stand-in for the Pico SDK's UART stdio driver, see pico/stdio/driver.h.
+
+#ifndef _SIM_PICO_STDIO_UART_H
+#define _SIM_PICO_STDIO_UART_H
+
+#include "pico/stdio/driver.h"
+
+extern stdio_driver_t stdio_uart;
+
+#endif
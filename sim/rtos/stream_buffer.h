@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Stand-in for FreeRTOS' stream_buffer.h, see FreeRTOS.h.
+
+#ifndef _SIM_STREAM_BUFFER_H
+#define _SIM_STREAM_BUFFER_H
+
+#include "FreeRTOS.h"
+
+typedef struct sim_stream_buffer *StreamBufferHandle_t;
+
+StreamBufferHandle_t xStreamBufferCreate(size_t buffer_size, size_t trigger_level);
+size_t xStreamBufferSend(StreamBufferHandle_t buffer, const void *data, size_t len,
+  TickType_t ticks_to_wait);
+size_t xStreamBufferReceive(StreamBufferHandle_t buffer, void *data, size_t len,
+  TickType_t ticks_to_wait);
+
+#endif
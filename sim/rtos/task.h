@@ -0,0 +1,41 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Stand-in for FreeRTOS' task.h, see FreeRTOS.h.
+
+#ifndef _SIM_TASK_H
+#define _SIM_TASK_H
+
+#include "FreeRTOS.h"
+
+typedef struct sim_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+BaseType_t xTaskCreate(TaskFunction_t code, const char *name, uint32_t stack_depth,
+  void *parameters, UBaseType_t priority, TaskHandle_t *created_task);
+BaseType_t xTaskCreateAffinitySet(TaskFunction_t code, const char *name, uint32_t stack_depth,
+  void *parameters, UBaseType_t priority, UBaseType_t core_affinity_mask,
+  TaskHandle_t *created_task);
+
+// Starts the tasks created so far. Doesn't return.
+void vTaskStartScheduler();
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higher_priority_task_woken);
+uint32_t ulTaskNotifyTake(BaseType_t clear_count_on_exit, TickType_t ticks_to_wait);
+
+TickType_t xTaskGetTickCount();
+BaseType_t xTaskDelayUntil(TickType_t *previous_wake_time, TickType_t time_increment);
+
+#endif
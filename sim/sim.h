@@ -0,0 +1,65 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _SIM_H
+#define _SIM_H
+
+#include "pico/stdlib.h"
+#include "tusb.h"
+
+// app.c's main, renamed by the simulator build. It runs on its own thread.
+int app_main();
+
+// Creates the pseudo terminal that stands in for the pogo UART and returns
+// the file descriptor of the peer's end. The adapter's end becomes uart1.
+int sim_pogo_open();
+
+// Number of write calls the adapter made on the pogo UART, i.e. separate
+// bursts on the line.
+extern uint32_t sim_pogo_writes;
+
+// Holds the adapter's pogo RX line low (false), like a detached or sleeping
+// reMarkable does, or lets it go idle high again.
+void sim_pogo_set_line(bool high);
+
+// Feeds a character into the adapter's debug console.
+void sim_console_push(char c);
+
+// Plugs in the virtual keyboard. Reports are only delivered once it's
+// mounted.
+void sim_usb_plug();
+bool sim_usb_mounted();
+// Whether the adapter has enabled remote wakeup on the virtual keyboard. Only
+// then does a key press wake it from suspend.
+bool sim_usb_remote_wakeup();
+
+// Stands in for power_suspend masking the USB interrupt. While masked,
+// tuh_task delivers nothing, which matters with RMK_FREERTOS, where the usb
+// task keeps running.
+void sim_usb_mask(bool masked);
+
+// Replaces the boot keyboard layout that tuh_hid_parse_report_descriptor
+// reports, e.g. with one from a captured trace. Call before sim_usb_plug.
+void sim_usb_set_layout(tuh_hid_report_info_t const *infos, uint8_t count);
+
+// Queues a report for delivery to tuh_hid_report_received_cb on the next
+// tuh_task. Returns false if the injection queue is full.
+bool sim_hid_inject(hid_keyboard_report_t const *report);
+bool sim_hid_inject_raw(uint8_t const *report, uint16_t len);
+
+// True if an injected report hasn't been delivered yet. While suspended, this
+// stands in for the keyboard's remote wakeup.
+bool sim_hid_pending();
+
+#endif
@@ -0,0 +1,240 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Host implementation of the FreeRTOS functions in rtos/, for the simulator's
+// FreeRTOS build. Every task is a thread, notifications and stream buffers
+// are a condition variable each.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sim.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "stream_buffer.h"
+#include "pico/stdio_uart.h"
+
+#define MAX_TASKS 8
+
+struct sim_task {
+  TaskFunction_t code;
+  void *parameters;
+  const char *name;
+  pthread_t thread;
+  uint32_t notifications;
+  pthread_cond_t notified;
+};
+
+struct sim_stream_buffer {
+  uint8_t *data;
+  size_t size, head, tail; // Both only ever increase.
+  pthread_cond_t changed;
+};
+
+static struct sim_task tasks[MAX_TASKS];
+static int task_count;
+static __thread struct sim_task *current_task;
+
+// Protects the notification counts and stream buffers.
+static pthread_mutex_t kernel_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t critical_lock;
+static pthread_once_t critical_once = PTHREAD_ONCE_INIT;
+
+static void cond_init(pthread_cond_t *cond) {
+  // Timeouts are against CLOCK_MONOTONIC, like time_us_64.
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(cond, &attr);
+  pthread_condattr_destroy(&attr);
+}
+
+// Waits on cond for at most ticks, or forever with portMAX_DELAY. Returns
+// false on timeout.
+static bool cond_wait_ticks(pthread_cond_t *cond, TickType_t ticks) {
+  if (ticks == portMAX_DELAY) {
+    pthread_cond_wait(cond, &kernel_lock);
+    return true;
+  }
+
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  uint64_t ns = ts.tv_nsec + (uint64_t)ticks * (1000000000 / configTICK_RATE_HZ);
+  ts.tv_sec += ns / 1000000000;
+  ts.tv_nsec = ns % 1000000000;
+  return pthread_cond_timedwait(cond, &kernel_lock, &ts) == 0;
+}
+
+static void critical_init() {
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&critical_lock, &attr);
+  pthread_mutexattr_destroy(&attr);
+}
+
+void vTaskEnterCritical() {
+  pthread_once(&critical_once, critical_init);
+  pthread_mutex_lock(&critical_lock);
+}
+
+void vTaskExitCritical() {
+  pthread_mutex_unlock(&critical_lock);
+}
+
+BaseType_t xTaskCreate(TaskFunction_t code, const char *name, uint32_t stack_depth,
+    void *parameters, UBaseType_t priority, TaskHandle_t *created_task) {
+  if (task_count == MAX_TASKS) {
+    panic("Too many tasks");
+  }
+
+  struct sim_task *task = &tasks[task_count++];
+  task->code = code;
+  task->parameters = parameters;
+  task->name = name;
+  cond_init(&task->notified);
+  if (created_task != NULL) {
+    *created_task = task;
+  }
+  return pdPASS;
+}
+
+BaseType_t xTaskCreateAffinitySet(TaskFunction_t code, const char *name, uint32_t stack_depth,
+    void *parameters, UBaseType_t priority, UBaseType_t core_affinity_mask,
+    TaskHandle_t *created_task) {
+  return xTaskCreate(code, name, stack_depth, parameters, priority, created_task);
+}
+
+static void *task_thread(void *arg) {
+  current_task = arg;
+  current_task->code(current_task->parameters);
+  panic("Task %s returned", current_task->name);
+  return NULL;
+}
+
+void vTaskStartScheduler() {
+  for (int i = 0; i < task_count; i++) {
+    pthread_create(&tasks[i].thread, NULL, task_thread, &tasks[i]);
+  }
+  for (int i = 0; i < task_count; i++) {
+    pthread_join(tasks[i].thread, NULL);
+  }
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  pthread_mutex_lock(&kernel_lock);
+  task->notifications++;
+  pthread_cond_signal(&task->notified);
+  pthread_mutex_unlock(&kernel_lock);
+  return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *higher_priority_task_woken) {
+  xTaskNotifyGive(task);
+  *higher_priority_task_woken = pdTRUE;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_count_on_exit, TickType_t ticks_to_wait) {
+  struct sim_task *task = current_task;
+
+  pthread_mutex_lock(&kernel_lock);
+  if (task->notifications == 0 && ticks_to_wait > 0) {
+    cond_wait_ticks(&task->notified, ticks_to_wait);
+  }
+  uint32_t count = task->notifications;
+  if (count > 0) {
+    task->notifications = clear_count_on_exit ? 0 : count - 1;
+  }
+  pthread_mutex_unlock(&kernel_lock);
+  return count;
+}
+
+TickType_t xTaskGetTickCount() {
+  return time_us_64() / (1000000 / configTICK_RATE_HZ);
+}
+
+BaseType_t xTaskDelayUntil(TickType_t *previous_wake_time, TickType_t time_increment) {
+  TickType_t wake_time = *previous_wake_time + time_increment;
+  TickType_t now = xTaskGetTickCount();
+  *previous_wake_time = wake_time;
+
+  if ((int32_t)(wake_time - now) <= 0) {
+    return pdFALSE;
+  }
+  sleep_us((uint64_t)(wake_time - now) * (1000000 / configTICK_RATE_HZ));
+  return pdTRUE;
+}
+
+StreamBufferHandle_t xStreamBufferCreate(size_t buffer_size, size_t trigger_level) {
+  struct sim_stream_buffer *buffer = calloc(1, sizeof(*buffer));
+  buffer->data = malloc(buffer_size);
+  buffer->size = buffer_size;
+  cond_init(&buffer->changed);
+  return buffer;
+}
+
+size_t xStreamBufferSend(StreamBufferHandle_t buffer, const void *data, size_t len,
+    TickType_t ticks_to_wait) {
+  size_t sent = 0;
+
+  pthread_mutex_lock(&kernel_lock);
+  while (buffer->head - buffer->tail == buffer->size) {
+    if (!cond_wait_ticks(&buffer->changed, ticks_to_wait)) {
+      break;
+    }
+  }
+  while (sent < len && buffer->head - buffer->tail < buffer->size) {
+    buffer->data[buffer->head++ % buffer->size] = ((const uint8_t *)data)[sent++];
+  }
+  pthread_cond_broadcast(&buffer->changed);
+  pthread_mutex_unlock(&kernel_lock);
+  return sent;
+}
+
+size_t xStreamBufferReceive(StreamBufferHandle_t buffer, void *data, size_t len,
+    TickType_t ticks_to_wait) {
+  size_t received = 0;
+
+  pthread_mutex_lock(&kernel_lock);
+  while (buffer->head == buffer->tail) {
+    if (!cond_wait_ticks(&buffer->changed, ticks_to_wait)) {
+      break;
+    }
+  }
+  while (received < len && buffer->tail != buffer->head) {
+    ((uint8_t *)data)[received++] = buffer->data[buffer->tail++ % buffer->size];
+  }
+  pthread_cond_broadcast(&buffer->changed);
+  pthread_mutex_unlock(&kernel_lock);
+  return received;
+}
+
+static void stdio_out_chars(const char *buf, int len) {
+  fwrite(buf, 1, len, stdout);
+}
+
+static int stdio_in_chars(char *buf, int len) {
+  return PICO_ERROR_TIMEOUT;
+}
+
+stdio_driver_t stdio_uart = {
+  .out_chars = stdio_out_chars,
+  .in_chars = stdio_in_chars
+};
+
+void stdio_set_driver_enabled(stdio_driver_t *driver, bool enabled) {
+}
@@ -0,0 +1,273 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Host implementation of the Pico SDK functions in include/pico/stdlib.h.
+
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sim.h"
+#include "pogo_uart.h"
+
+uart_inst_t sim_uart1 = { .fd = -1 };
+uint32_t sim_pogo_writes = 0;
+static volatile bool pogo_line_high = true;
+
+static uint64_t boot_time_us = 0;
+
+static uint64_t monotonic_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint64_t time_us_64() {
+  if (boot_time_us == 0) {
+    boot_time_us = monotonic_us() - 1;
+  }
+  return monotonic_us() - boot_time_us;
+}
+
+uint32_t time_us_32() {
+  return (uint32_t)time_us_64();
+}
+
+absolute_time_t get_absolute_time() {
+  return time_us_64();
+}
+
+int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to) {
+  return (int64_t)(to - from);
+}
+
+void sleep_us(uint64_t us) {
+  struct timespec ts = { .tv_sec = us / 1000000, .tv_nsec = (us % 1000000) * 1000 };
+  nanosleep(&ts, NULL);
+}
+
+void sleep_ms(uint32_t ms) {
+  sleep_us((uint64_t)ms * 1000);
+}
+
+// Pending alarms, ordered by nothing. alarm_thread sleeps until the earliest.
+#define MAX_ALARMS 8
+
+typedef struct sim_alarm {
+  alarm_id_t id; // 0 if the slot is free.
+  uint64_t at_us;
+  alarm_callback_t callback;
+  void *user_data;
+} sim_alarm_t;
+
+static sim_alarm_t alarms[MAX_ALARMS];
+static alarm_id_t next_alarm_id = 1;
+static pthread_mutex_t alarm_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t alarm_cond;
+static pthread_once_t alarm_once = PTHREAD_ONCE_INIT;
+
+static void *alarm_thread(void *unused) {
+  pthread_mutex_lock(&alarm_lock);
+  while (true) {
+    sim_alarm_t *next = NULL;
+    for (int i = 0; i < MAX_ALARMS; i++) {
+      if (alarms[i].id != 0 && (next == NULL || alarms[i].at_us < next->at_us)) {
+        next = &alarms[i];
+      }
+    }
+
+    if (next == NULL) {
+      pthread_cond_wait(&alarm_cond, &alarm_lock);
+      continue;
+    }
+    if (next->at_us > time_us_64()) {
+      uint64_t deadline = boot_time_us + next->at_us;
+      struct timespec ts = { .tv_sec = deadline / 1000000, .tv_nsec = (deadline % 1000000) * 1000 };
+      pthread_cond_timedwait(&alarm_cond, &alarm_lock, &ts);
+      continue;
+    }
+
+    sim_alarm_t fired = *next;
+    next->id = 0;
+    pthread_mutex_unlock(&alarm_lock);
+    fired.callback(fired.id, fired.user_data);
+    pthread_mutex_lock(&alarm_lock);
+  }
+  return NULL;
+}
+
+static void alarm_init() {
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&alarm_cond, &attr);
+
+  pthread_t thread;
+  pthread_create(&thread, NULL, alarm_thread, NULL);
+}
+
+alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback, void *user_data, bool fire_if_past) {
+  if (us == 0 && fire_if_past) {
+    callback(0, user_data);
+    return 0;
+  }
+
+  pthread_once(&alarm_once, alarm_init);
+  alarm_id_t id = -1;
+  pthread_mutex_lock(&alarm_lock);
+  for (int i = 0; i < MAX_ALARMS; i++) {
+    if (alarms[i].id == 0) {
+      id = next_alarm_id++;
+      alarms[i] = (sim_alarm_t){ id, time_us_64() + us, callback, user_data };
+      pthread_cond_signal(&alarm_cond);
+      break;
+    }
+  }
+  pthread_mutex_unlock(&alarm_lock);
+  return id;
+}
+
+bool cancel_alarm(alarm_id_t alarm_id) {
+  bool cancelled = false;
+  pthread_mutex_lock(&alarm_lock);
+  for (int i = 0; i < MAX_ALARMS; i++) {
+    if (alarm_id != 0 && alarms[i].id == alarm_id) {
+      alarms[i].id = 0;
+      cancelled = true;
+    }
+  }
+  pthread_mutex_unlock(&alarm_lock);
+  return cancelled;
+}
+
+// The debug console is a small queue that the simulator pushes into.
+#define CONSOLE_LEN 16
+static char console_queue[CONSOLE_LEN];
+static uint8_t console_write_ix, console_read_ix;
+static pthread_mutex_t console_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void stdio_uart_init() {
+}
+
+void sim_console_push(char c) {
+  pthread_mutex_lock(&console_lock);
+  uint8_t next = (console_write_ix + 1) % CONSOLE_LEN;
+  if (next != console_read_ix) {
+    console_queue[console_write_ix] = c;
+    console_write_ix = next;
+  }
+  pthread_mutex_unlock(&console_lock);
+}
+
+int getchar_timeout_us(uint32_t timeout_us) {
+  int c = PICO_ERROR_TIMEOUT;
+
+  pthread_mutex_lock(&console_lock);
+  if (console_read_ix != console_write_ix) {
+    c = (unsigned char)console_queue[console_read_ix];
+    console_read_ix = (console_read_ix + 1) % CONSOLE_LEN;
+  }
+  pthread_mutex_unlock(&console_lock);
+
+  return c;
+}
+
+void panic(const char *fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  vfprintf(stderr, fmt, args);
+  va_end(args);
+  fputc('\n', stderr);
+  _exit(1);
+}
+
+int sim_pogo_open() {
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) < 0 || unlockpt(master) < 0) {
+    perror("posix_openpt");
+    exit(1);
+  }
+
+  int peer = open(ptsname(master), O_RDWR | O_NOCTTY);
+  if (peer < 0) {
+    perror("open pty");
+    exit(1);
+  }
+
+  // Without raw mode the line discipline would echo and translate bytes.
+  struct termios tio;
+  tcgetattr(peer, &tio);
+  cfmakeraw(&tio);
+  tcsetattr(peer, TCSANOW, &tio);
+
+  sim_uart1.fd = master;
+  return peer;
+}
+
+void sim_pogo_set_line(bool high) {
+  pogo_line_high = high;
+}
+
+bool gpio_get(unsigned int gpio) {
+  return gpio == POGO_UART_RX_PIN ? pogo_line_high : true;
+}
+
+unsigned int uart_init(uart_inst_t *uart, unsigned int baudrate) {
+  return baudrate;
+}
+
+bool uart_is_readable(uart_inst_t *uart) {
+  struct pollfd pfd = { .fd = uart->fd, .events = POLLIN };
+  return poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN);
+}
+
+char uart_getc(uart_inst_t *uart) {
+  char c = 0;
+  while (read(uart->fd, &c, 1) != 1) {
+  }
+  return c;
+}
+
+void uart_putc(uart_inst_t *uart, char c) {
+  uart_write_blocking(uart, (const uint8_t *)&c, 1);
+}
+
+void uart_write_blocking(uart_inst_t *uart, const uint8_t *src, size_t len) {
+  if (uart == &sim_uart1) {
+    sim_pogo_writes++;
+  }
+  while (len > 0) {
+    ssize_t written = write(uart->fd, src, len);
+    if (written <= 0) {
+      continue;
+    }
+    src += written;
+    len -= written;
+  }
+}
+
+void uart_tx_wait_blocking(uart_inst_t *uart) {
+  // Writes to the pseudo terminal are done once write() returns.
+}
+
+unsigned int uart_set_baudrate(uart_inst_t *uart, unsigned int baudrate) {
+  return baudrate;
+}
@@ -0,0 +1,46 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Host implementation of power.h. There are no clocks to change, we just wait
+// for the same things that wake up the real hardware. The clock states are
+// still counted by clock_scaling.c.
+
+#include "sim.h"
+#include "power.h"
+
+void power_init() {
+}
+
+void power_set_clock(power_clock_t clock) {
+}
+
+power_wake_t power_suspend() {
+  power_wake_t wake;
+
+  sim_usb_mask(true);
+  while (true) {
+    if (uart_is_readable(uart1)) {
+      wake = POWER_WAKE_POGO;
+      break;
+    }
+    if (sim_hid_pending() && sim_usb_remote_wakeup()) {
+      wake = POWER_WAKE_KEYBOARD;
+      break;
+    }
+    sleep_us(100);
+  }
+  sim_usb_mask(false);
+
+  return wake;
+}
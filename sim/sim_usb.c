@@ -0,0 +1,241 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Host implementation of the TinyUSB functions in include/tusb.h. There is a
+// single virtual keyboard at address 1, instance 0. By default it's a boot
+// keyboard.
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#include "sim.h"
+#include "host/hcd.h"
+
+#define SIM_DEV_ADDR 1
+#define SIM_INSTANCE 0
+#define SIM_VID 0xcafe
+#define SIM_PID 0x4b42
+
+#define INJECT_QUEUE_LEN 256
+
+typedef struct injected_report {
+  uint16_t len;
+  uint8_t data[CFG_TUH_HID_EP_BUFSIZE];
+} injected_report_t;
+
+static injected_report_t inject_queue[INJECT_QUEUE_LEN];
+static uint16_t inject_write_ix, inject_read_ix;
+static pthread_mutex_t inject_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t injected = PTHREAD_COND_INITIALIZER;
+
+static volatile bool plugged = false;
+static volatile bool mounted = false;
+static volatile bool remote_wakeup = false;
+static volatile bool masked = false;
+
+static tuh_hid_report_info_t layout[4] = {
+  { .report_id = 0, .usage = HID_USAGE_DESKTOP_KEYBOARD, .usage_page = HID_USAGE_PAGE_DESKTOP }
+};
+static uint8_t layout_count = 1;
+
+// The report descriptor is never looked at, tuh_hid_parse_report_descriptor
+// below returns the layout above.
+static uint8_t const desc_report[] = { 0x05, 0x01, 0x09, 0x06 };
+
+bool tusb_init() {
+  return true;
+}
+
+bool tuh_inited() {
+  return true;
+}
+
+void sim_usb_set_layout(tuh_hid_report_info_t const *infos, uint8_t count) {
+  layout_count = count < 4 ? count : 4;
+  memcpy(layout, infos, layout_count * sizeof(layout[0]));
+}
+
+void sim_usb_plug() {
+  plugged = true;
+}
+
+bool sim_usb_mounted() {
+  return mounted;
+}
+
+bool hcd_port_connect_status(uint8_t rhport) {
+  return plugged;
+}
+
+bool __real_hcd_edpt_open(uint8_t rhport, uint8_t dev_addr, tusb_desc_endpoint_t const *ep_desc) {
+  return true;
+}
+
+bool tuh_vid_pid_get(uint8_t dev_addr, uint16_t *vid, uint16_t *pid) {
+  *vid = SIM_VID;
+  *pid = SIM_PID;
+  return true;
+}
+
+bool tuh_descriptor_get_configuration(uint8_t daddr, uint8_t index, void *buffer, uint16_t len,
+    tuh_xfer_cb_t complete_cb, uintptr_t user_data) {
+  tusb_desc_configuration_t const config = {
+    .bLength = sizeof(tusb_desc_configuration_t),
+    .bDescriptorType = 0x02,
+    .wTotalLength = sizeof(tusb_desc_configuration_t),
+    .bNumInterfaces = 1,
+    .bConfigurationValue = 1,
+    .bmAttributes = 0x80 | TUSB_DESC_CONFIG_ATT_REMOTE_WAKEUP,
+    .bMaxPower = 50
+  };
+  len = len < sizeof(config) ? len : sizeof(config);
+  memcpy(buffer, &config, len);
+
+  tuh_xfer_t xfer = {
+    .daddr = daddr,
+    .result = XFER_RESULT_SUCCESS,
+    .actual_len = len,
+    .buffer = buffer,
+    .complete_cb = complete_cb,
+    .user_data = user_data
+  };
+  complete_cb(&xfer);
+  return true;
+}
+
+bool tuh_control_xfer(tuh_xfer_t *xfer) {
+  tusb_control_request_t const *request = xfer->setup;
+  if (request->bRequest == TUSB_REQ_SET_FEATURE && request->wValue == TUSB_REQ_FEATURE_REMOTE_WAKEUP) {
+    remote_wakeup = true;
+  }
+
+  tuh_xfer_t done = *xfer;
+  done.result = XFER_RESULT_SUCCESS;
+  done.actual_len = 0;
+  if (done.complete_cb != NULL) {
+    done.complete_cb(&done);
+  }
+  return true;
+}
+
+void sim_usb_mask(bool mask) {
+  masked = mask;
+}
+
+bool sim_usb_remote_wakeup() {
+  return remote_wakeup;
+}
+
+uint8_t tuh_hid_parse_report_descriptor(tuh_hid_report_info_t *report_info_arr, uint8_t arr_count,
+    uint8_t const *desc, uint16_t desc_len) {
+  uint8_t count = layout_count < arr_count ? layout_count : arr_count;
+  memcpy(report_info_arr, layout, count * sizeof(layout[0]));
+  return count;
+}
+
+bool tuh_hid_receive_report(uint8_t dev_addr, uint8_t instance) {
+  return true;
+}
+
+bool sim_hid_inject(hid_keyboard_report_t const *report) {
+  return sim_hid_inject_raw((uint8_t const *)report, sizeof(*report));
+}
+
+bool sim_hid_inject_raw(uint8_t const *report, uint16_t len) {
+  bool queued = false;
+
+  if (len > CFG_TUH_HID_EP_BUFSIZE) {
+    len = CFG_TUH_HID_EP_BUFSIZE;
+  }
+
+  pthread_mutex_lock(&inject_lock);
+  uint16_t next = (inject_write_ix + 1) % INJECT_QUEUE_LEN;
+  if (next != inject_read_ix) {
+    inject_queue[inject_write_ix].len = len;
+    memcpy(inject_queue[inject_write_ix].data, report, len);
+    inject_write_ix = next;
+    queued = true;
+    pthread_cond_signal(&injected);
+  }
+  pthread_mutex_unlock(&inject_lock);
+
+  return queued;
+}
+
+bool sim_hid_pending() {
+  pthread_mutex_lock(&inject_lock);
+  bool pending = inject_read_ix != inject_write_ix;
+  pthread_mutex_unlock(&inject_lock);
+  return pending;
+}
+
+void tuh_task() {
+  if (masked) {
+    return;
+  }
+
+  if (plugged && !mounted) {
+    // Pretend to enumerate the endpoint so the polling interval code runs.
+    tusb_desc_endpoint_t ep = {
+      .bLength = sizeof(tusb_desc_endpoint_t),
+      .bDescriptorType = 0x05,
+      .bEndpointAddress = 0x81,
+      .bmAttributes = { .xfer = TUSB_XFER_INTERRUPT },
+      .wMaxPacketSize = 8,
+      .bInterval = 10
+    };
+    extern bool __wrap_hcd_edpt_open(uint8_t, uint8_t, tusb_desc_endpoint_t const *);
+    __wrap_hcd_edpt_open(0, SIM_DEV_ADDR, &ep);
+
+    tuh_hid_mount_cb(SIM_DEV_ADDR, SIM_INSTANCE, desc_report, sizeof(desc_report));
+    tuh_mount_cb(SIM_DEV_ADDR);
+    mounted = true;
+  }
+
+  // Like the real hardware, deliver at most one report per instance and
+  // tuh_task call.
+  injected_report_t report;
+  bool have_report = false;
+
+  pthread_mutex_lock(&inject_lock);
+  if (inject_read_ix != inject_write_ix) {
+    report = inject_queue[inject_read_ix];
+    inject_read_ix = (inject_read_ix + 1) % INJECT_QUEUE_LEN;
+    have_report = true;
+  }
+  pthread_mutex_unlock(&inject_lock);
+
+  if (have_report && mounted) {
+    tuh_hid_report_received_cb(SIM_DEV_ADDR, SIM_INSTANCE, report.data, report.len);
+  }
+}
+
+// Stands in for TinyUSB blocking on its event queue with FreeRTOS. Injecting a
+// report is the only event there is once the keyboard is mounted.
+void tuh_task_ext(uint32_t timeout_ms, bool in_isr) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  uint64_t ns = ts.tv_nsec + (uint64_t)timeout_ms * 1000000;
+  ts.tv_sec += ns / 1000000000;
+  ts.tv_nsec = ns % 1000000000;
+
+  pthread_mutex_lock(&inject_lock);
+  if (mounted && (masked || inject_read_ix == inject_write_ix)) {
+    pthread_cond_timedwait(&injected, &inject_lock, &ts);
+  }
+  pthread_mutex_unlock(&inject_lock);
+
+  tuh_task();
+}
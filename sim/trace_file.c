@@ -0,0 +1,89 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "trace_file.h"
+
+static uint32_t read_u32(uint8_t const *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+bool trace_file_load(const char *path, trace_file_t *trace) {
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) {
+    perror(path);
+    return false;
+  }
+
+  uint8_t header[TRACE_HEADER_LEN];
+  if (fread(header, 1, sizeof(header), f) != sizeof(header) ||
+      memcmp(header, TRACE_MAGIC, 4) != 0 || header[4] != TRACE_VERSION) {
+    fprintf(stderr, "%s: Not a version %d trace\n", path, TRACE_VERSION);
+    fclose(f);
+    return false;
+  }
+  trace->start_time = read_u32(header + 8);
+  trace->record_count = read_u32(header + 12);
+
+  fseek(f, 0, SEEK_END);
+  trace->records_len = ftell(f) - TRACE_HEADER_LEN;
+  fseek(f, TRACE_HEADER_LEN, SEEK_SET);
+  trace->records = malloc(trace->records_len);
+  if (fread(trace->records, 1, trace->records_len, f) != trace->records_len) {
+    fprintf(stderr, "%s: Truncated trace\n", path);
+    fclose(f);
+    return false;
+  }
+
+  fclose(f);
+  return true;
+}
+
+void trace_file_rewind(trace_file_t const *trace, trace_file_cursor_t *cursor) {
+  cursor->pos = 0;
+  cursor->time = trace->start_time;
+}
+
+bool trace_file_next(trace_file_t const *trace, trace_file_cursor_t *cursor, trace_entry_t *entry, bool *malformed) {
+  uint8_t const *p = trace->records + cursor->pos;
+  size_t remaining = trace->records_len - cursor->pos;
+
+  *malformed = false;
+  if (remaining == 0) {
+    return false;
+  }
+
+  size_t header = (p[0] & TRACE_FLAG_ABSOLUTE) ? 6 : 4;
+  if (remaining < header || remaining < header + p[header - 1]) {
+    *malformed = true;
+    return false;
+  }
+
+  if (p[0] & TRACE_FLAG_ABSOLUTE) {
+    cursor->time = read_u32(p + 1);
+  } else {
+    cursor->time += p[1] | (p[2] << 8);
+  }
+
+  entry->type = p[0] & TRACE_TYPE_MASK;
+  entry->time = cursor->time;
+  entry->len = p[header - 1];
+  memcpy(entry->data, p + header, entry->len);
+
+  cursor->pos += header + entry->len;
+  return true;
+}
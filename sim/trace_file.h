@@ -0,0 +1,45 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _TRACE_FILE_H
+#define _TRACE_FILE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "trace.h"
+
+// A trace as written by trace_serialize, loaded into memory.
+typedef struct trace_file {
+  uint32_t start_time;
+  uint32_t record_count;
+  uint8_t *records;
+  size_t records_len;
+} trace_file_t;
+
+typedef struct trace_file_cursor {
+  size_t pos;
+  uint32_t time;
+} trace_file_cursor_t;
+
+bool trace_file_load(const char *path, trace_file_t *trace);
+
+void trace_file_rewind(trace_file_t const *trace, trace_file_cursor_t *cursor);
+
+// Returns false at the end of the trace. Sets *malformed if the record at the
+// cursor is cut off.
+bool trace_file_next(trace_file_t const *trace, trace_file_cursor_t *cursor, trace_entry_t *entry, bool *malformed);
+
+#endif
@@ -0,0 +1,158 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+// Replays the received bytes of a pogo trace (see trace.h) into
+// rx_process_byte, either as fast as possible to benchmark the parser, or
+// with the original timing. With -p, every parsed packet is printed, which
+// makes traces usable as regression fixtures.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pico/stdlib.h"
+#include "packet.h"
+#include "command.h"
+#include "trace.h"
+#include "trace_file.h"
+
+typedef struct replay_stats {
+  uint64_t bytes;
+  uint32_t packets;
+  uint32_t invalid_frames;
+} replay_stats_t;
+
+static FILE *out;
+
+static void print_rx_packet() {
+  fprintf(out, "%s %d", command_name(rx_packet.command), rx_packet.data_length);
+  for (int i = 0; i < rx_packet.data_length; i++) {
+    fprintf(out, " %02x", rx_packet.data[i]);
+  }
+  fprintf(out, "\n");
+}
+
+static void handle_result(rx_result_t result, bool print, replay_stats_t *stats) {
+  switch (result) {
+    case RX_PACKET_RECEIVED:
+      stats->packets++;
+      if (print) {
+        print_rx_packet();
+      }
+      break;
+    case RX_PACKET_INVALID_CHECKSUM:
+    case RX_PACKET_INVALID_FRAME:
+      stats->invalid_frames++;
+      break;
+    default:
+      break;
+  }
+}
+
+// Replays the whole trace once. With realtime set, sleeps so that bytes
+// arrive with the same spacing as in the capture.
+static bool replay(trace_file_t const *trace, bool realtime, bool print, replay_stats_t *stats) {
+  trace_file_cursor_t cursor;
+  trace_entry_t entry;
+  bool malformed;
+  uint64_t replay_start = time_us_64();
+
+  rx_switch_to_init_state();
+  trace_file_rewind(trace, &cursor);
+
+  while (trace_file_next(trace, &cursor, &entry, &malformed)) {
+    if (entry.type != TRACE_POGO_RX) {
+      continue;
+    }
+
+    if (realtime) {
+      uint64_t due = replay_start + (uint32_t)(entry.time - trace->start_time);
+      uint64_t now = time_us_64();
+      if (due > now) {
+        sleep_us(due - now);
+      }
+    }
+
+    for (uint8_t i = 0; i < entry.len; i++) {
+      handle_result(rx_process_byte(entry.data[i]), print, stats);
+      while (rx_resync_pending()) {
+        handle_result(rx_process_pending(), print, stats);
+      }
+    }
+    stats->bytes += entry.len;
+  }
+
+  return !malformed;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr,
+    "Usage: %s [options] TRACE\n"
+    "  -n N  Replay the trace N times (default: 1)\n"
+    "  -t    Keep the original timing instead of replaying at full speed\n"
+    "  -p    Print every received packet\n", name);
+}
+
+int main(int argc, char **argv) {
+  int iterations = 1;
+  bool realtime = false;
+  bool print = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:tph")) != -1) {
+    switch (opt) {
+      case 'n': iterations = atoi(optarg); break;
+      case 't': realtime = true; break;
+      case 'p': print = true; break;
+      default: usage(argv[0]); return 2;
+    }
+  }
+  if (optind != argc - 1) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  // The parser logs to stdout, keep that out of our output.
+  out = fdopen(dup(STDOUT_FILENO), "w");
+  freopen("/dev/null", "w", stdout);
+
+  trace_file_t trace;
+  if (!trace_file_load(argv[optind], &trace)) {
+    return 1;
+  }
+
+  replay_stats_t stats = {0};
+  struct timespec start, stop;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i = 0; i < iterations; i++) {
+    if (!replay(&trace, realtime, print, &stats)) {
+      fprintf(stderr, "%s: Malformed record\n", argv[optind]);
+      return 1;
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &stop);
+
+  double seconds = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+  fprintf(out, "%u records, %llu bytes, %u packets, %u bad frames, %u salvaged\n",
+    trace.record_count * iterations, (unsigned long long)stats.bytes, stats.packets,
+    stats.invalid_frames, rx_stats.frames_salvaged);
+  if (!realtime && seconds > 0) {
+    fprintf(out, "%.3f s, %.1f MB/s, %.0f ns/byte\n",
+      seconds, stats.bytes / seconds / 1e6, seconds * 1e9 / stats.bytes);
+  }
+
+  return 0;
+}
@@ -0,0 +1,182 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+
+#include "tap_hold.h"
+#include "rm_keyboard.h"
+#include "rtos.h"
+#include "hot_path.h"
+#include "tusb.h"
+
+tap_hold_stats_t tap_hold_stats;
+
+#if RMK_TAP_HOLD_MS
+
+// Caps Lock sits where other keyboards have Ctrl. The reMarkable has no
+// Escape key, so a tap stays Caps Lock.
+static const tap_hold_key_t RMK_HOT_DATA(tap_hold_keys)[] = {
+  { HID_KEY_CAPS_LOCK, HID_KEY_CAPS_LOCK, HID_KEY_CONTROL_LEFT }
+};
+
+#define TAP_HOLD_KEYS (sizeof(tap_hold_keys) / sizeof(tap_hold_keys[0]))
+
+// The dual-role key that is down but not decided yet, if any.
+static tap_hold_key_t const *pending = NULL;
+static uint32_t pending_since_us;
+static alarm_id_t pending_alarm = 0;
+static volatile bool pending_expired = false;
+
+// Dual-role keys decided as held. Their release sends the hold key up.
+static bool held[TAP_HOLD_KEYS];
+
+// Runs in interrupt context, the hold key is sent by tap_hold_task.
+static int64_t tap_hold_alarm(alarm_id_t id, void *unused) {
+  pending_expired = true;
+  rtos_notify_pogo_from_isr();
+  return 0;
+}
+
+static tap_hold_key_t const *RMK_HOT(tap_hold_find)(uint8_t key) {
+  for (uint8_t i = 0; i < TAP_HOLD_KEYS; i++) {
+    if (tap_hold_keys[i].key == key) {
+      return &tap_hold_keys[i];
+    }
+  }
+  return NULL;
+}
+
+static void RMK_HOT(tap_hold_send)(key_event_type_t type, uint8_t key) {
+  key_event_t event = { .type = type, .keycode = key };
+  rmk_process_event(&event);
+}
+
+static void RMK_HOT(tap_hold_decided)() {
+  if (pending_alarm > 0) {
+    cancel_alarm(pending_alarm);
+  }
+  pending_alarm = 0;
+  pending_expired = false;
+  pending = NULL;
+
+  uint32_t took = time_us_32() - pending_since_us;
+  tap_hold_stats.last_decision_us = took;
+  tap_hold_stats.total_decision_us += took;
+  if (took > tap_hold_stats.max_decision_us) {
+    tap_hold_stats.max_decision_us = took;
+  }
+}
+
+static void RMK_HOT(tap_hold_decide_hold)() {
+  held[pending - tap_hold_keys] = true;
+  tap_hold_stats.holds++;
+  tap_hold_send(KEY_DOWN, pending->hold);
+  tap_hold_decided();
+}
+
+static void RMK_HOT(tap_hold_start)(tap_hold_key_t const *key, uint32_t since_us) {
+  pending = key;
+  pending_since_us = since_us;
+  pending_expired = false;
+
+  // The term runs from when the key was queued, not from when we got to it.
+  int64_t remaining = (int64_t)RMK_TAP_HOLD_MS * 1000 - (int32_t)(time_us_32() - since_us);
+  pending_alarm = add_alarm_in_us(remaining > 0 ? remaining : 0, tap_hold_alarm, NULL, true);
+  if (pending_alarm < 0) {
+    // Out of alarms, decide right away rather than wait for the release.
+    pending_expired = true;
+  }
+}
+
+void RMK_HOT(tap_hold_process_event)(key_event_t *event) {
+  tap_hold_key_t const *key = tap_hold_find(event->keycode);
+  if (key == NULL) {
+    if (pending != NULL && event->type == KEY_DOWN) {
+      tap_hold_stats.holds_by_key++;
+      tap_hold_decide_hold();
+    }
+    rmk_process_event(event);
+    return;
+  }
+
+  if (event->type == KEY_DOWN) {
+    if (pending != NULL) {
+      tap_hold_stats.holds_by_key++;
+      tap_hold_decide_hold();
+    }
+    tap_hold_start(key, event->queued_us);
+    return;
+  }
+
+  if (pending == key && pending_expired) {
+    // The alarm fired, but tap_hold_task hasn't run since.
+    tap_hold_decide_hold();
+  }
+
+  if (pending == key) {
+    tap_hold_stats.taps++;
+    tap_hold_send(KEY_DOWN, key->tap);
+    tap_hold_send(KEY_UP, key->tap);
+    tap_hold_decided();
+  } else if (held[key - tap_hold_keys]) {
+    held[key - tap_hold_keys] = false;
+    tap_hold_send(KEY_UP, key->hold);
+  }
+  // Otherwise we never saw it go down, e.g. because that was before keyboard
+  // mode.
+}
+
+void RMK_HOT(tap_hold_task)() {
+  if (pending_expired && pending != NULL) {
+    tap_hold_decide_hold();
+  }
+}
+
+void tap_hold_reset() {
+  if (pending_alarm > 0) {
+    cancel_alarm(pending_alarm);
+  }
+  pending_alarm = 0;
+  pending_expired = false;
+  pending = NULL;
+  memset(held, 0, sizeof(held));
+}
+
+#else
+
+void RMK_HOT(tap_hold_process_event)(key_event_t *event) {
+  rmk_process_event(event);
+}
+
+void tap_hold_task() {
+}
+
+void tap_hold_reset() {
+}
+
+#endif
+
+void tap_hold_print_stats() {
+#if RMK_TAP_HOLD_MS
+  uint32_t decisions = tap_hold_stats.taps + tap_hold_stats.holds;
+  printf("Tap-hold: %lu taps, %lu holds (%lu by another key), decision last %lu us, "
+    "avg %lu us, max %lu us\n",
+    tap_hold_stats.taps, tap_hold_stats.holds, tap_hold_stats.holds_by_key,
+    tap_hold_stats.last_decision_us,
+    decisions ? (uint32_t)(tap_hold_stats.total_decision_us / decisions) : 0,
+    tap_hold_stats.max_decision_us);
+#endif
+}
@@ -0,0 +1,63 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _TAP_HOLD_H
+#define _TAP_HOLD_H
+
+#include "pico/stdlib.h"
+#include "app.h"
+#include "config.h"
+
+// Dual-role keys (with RMK_TAP_HOLD_MS): a key in tap_hold_keys sends its tap
+// key when it's pressed and released on its own, and its hold key when it's
+// held for RMK_TAP_HOLD_MS or another key goes down while it's held. Until
+// then, nothing is sent for it. The timeout is an alarm, so the decision
+// doesn't depend on how often the loop comes around.
+//
+// Everything else goes straight through to rmk_process_event, also while a
+// dual-role key is undecided: a key press decides it as held first, so the
+// modifier is down before the key it modifies.
+
+typedef struct tap_hold_key {
+  uint8_t key; // HID usage of the physical key.
+  uint8_t tap;
+  uint8_t hold;
+} tap_hold_key_t;
+
+typedef struct tap_hold_stats {
+  uint32_t taps;
+  uint32_t holds; // Including the ones below.
+  uint32_t holds_by_key; // Decided early, by another key going down.
+  // From the dual-role key going down to its first event being sent.
+  uint32_t last_decision_us;
+  uint32_t max_decision_us;
+  uint64_t total_decision_us;
+} tap_hold_stats_t;
+
+extern tap_hold_stats_t tap_hold_stats;
+
+// Takes over from rmk_process_event in the pogo loop.
+void tap_hold_process_event(key_event_t *event);
+
+// Sends the hold key of an undecided key once its alarm has fired. Call this
+// from the pogo loop in keyboard mode, before processing new events.
+void tap_hold_task();
+
+// Forgets about all dual-role keys that are down, decided or not, without
+// sending anything. For app_sync_keys, which sends them again.
+void tap_hold_reset();
+
+void tap_hold_print_stats();
+
+#endif
@@ -0,0 +1,213 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+
+#include "trace.h"
+#include "crash.h"
+#include "hot_path.h"
+
+#if RMK_TRACE
+
+#if RMK_FREERTOS
+#include "FreeRTOS.h"
+#include "task.h"
+#endif
+
+#if (RMK_TRACE_BUFFER_SIZE & (RMK_TRACE_BUFFER_SIZE - 1)) != 0
+#error RMK_TRACE_BUFFER_SIZE must be a power of two
+#endif
+
+#define TRACE_MASK (RMK_TRACE_BUFFER_SIZE - 1)
+
+// Records go in at head and get evicted at tail. Both only ever increase, the
+// position in the buffer is the index masked with TRACE_MASK.
+static uint8_t trace_buffer[RMK_TRACE_BUFFER_SIZE];
+static uint32_t trace_head, trace_tail;
+static uint32_t trace_records;
+
+static bool trace_running = false;
+static uint32_t trace_dropped = 0;
+
+// Time of the newest record, and time of the record just before the oldest
+// one that's still in the buffer (or when the capture started).
+static uint32_t trace_last_time;
+static uint32_t trace_base_time;
+
+static inline uint8_t ring_peek(uint32_t ix) {
+  return trace_buffer[ix & TRACE_MASK];
+}
+
+static inline void ring_put(uint8_t data) {
+  trace_buffer[trace_head++ & TRACE_MASK] = data;
+}
+
+// Reads the record at ix. Returns its total length and adds its time to *time.
+static uint32_t record_at(uint32_t ix, uint32_t *time) {
+  uint8_t type = ring_peek(ix);
+  if (type & TRACE_FLAG_ABSOLUTE) {
+    *time = ring_peek(ix + 1) | (ring_peek(ix + 2) << 8) |
+      (ring_peek(ix + 3) << 16) | ((uint32_t)ring_peek(ix + 4) << 24);
+    return 6 + ring_peek(ix + 5);
+  }
+
+  *time += ring_peek(ix + 1) | (ring_peek(ix + 2) << 8);
+  return 4 + ring_peek(ix + 3);
+}
+
+static void RMK_HOT(evict_oldest)() {
+  trace_tail += record_at(trace_tail, &trace_base_time);
+  trace_records--;
+  trace_dropped++;
+}
+
+void trace_start() {
+  trace_head = trace_tail = 0;
+  trace_records = 0;
+  trace_dropped = 0;
+  trace_base_time = trace_last_time = time_us_32();
+  trace_running = true;
+}
+
+void trace_stop() {
+  trace_running = false;
+}
+
+bool trace_is_running() {
+  return trace_running;
+}
+
+void RMK_HOT(trace_record)(trace_type_t type, uint8_t const *data, uint8_t len) {
+  if (!trace_running) {
+    return;
+  }
+
+#if RMK_FREERTOS
+  // The pogo and the usb task record from different cores.
+  taskENTER_CRITICAL();
+#endif
+
+  uint32_t now = time_us_32();
+  uint32_t delta = now - trace_last_time;
+  bool absolute = delta > 0xffff;
+  uint32_t needed = (absolute ? 6 : 4) + len;
+
+  while (RMK_TRACE_BUFFER_SIZE - (trace_head - trace_tail) < needed) {
+    evict_oldest();
+  }
+
+  if (absolute) {
+    ring_put(type | TRACE_FLAG_ABSOLUTE);
+    ring_put(now >> 0);
+    ring_put(now >> 8);
+    ring_put(now >> 16);
+    ring_put(now >> 24);
+  } else {
+    ring_put(type);
+    ring_put(delta >> 0);
+    ring_put(delta >> 8);
+  }
+  ring_put(len);
+  for (uint8_t i = 0; i < len; i++) {
+    ring_put(data[i]);
+  }
+
+  trace_last_time = now;
+  trace_records++;
+
+#if RMK_FREERTOS
+  taskEXIT_CRITICAL();
+#endif
+}
+
+void trace_serialize(trace_writer_t writer, void *ctx) {
+  uint8_t header[TRACE_HEADER_LEN] = {
+    'R', 'M', 'K', 'T', TRACE_VERSION, 0, 0, 0,
+    trace_base_time >> 0, trace_base_time >> 8, trace_base_time >> 16, trace_base_time >> 24,
+    trace_records >> 0, trace_records >> 8, trace_records >> 16, trace_records >> 24
+  };
+  writer(header, sizeof(header), ctx);
+
+  // The records may wrap around the end of the buffer.
+  uint32_t start = trace_tail & TRACE_MASK;
+  uint32_t len = trace_head - trace_tail;
+  uint32_t first = len < RMK_TRACE_BUFFER_SIZE - start ? len : RMK_TRACE_BUFFER_SIZE - start;
+  writer(trace_buffer + start, first, ctx);
+  if (len > first) {
+    writer(trace_buffer, len - first, ctx);
+  }
+}
+
+void trace_cursor_init(trace_cursor_t *cursor) {
+  cursor->ix = trace_tail;
+  cursor->time = trace_base_time;
+}
+
+bool trace_next(trace_cursor_t *cursor, trace_entry_t *entry) {
+  if (cursor->ix - trace_tail >= trace_head - trace_tail) {
+    return false;
+  }
+
+  uint32_t ix = cursor->ix;
+  uint32_t len = record_at(ix, &cursor->time);
+  uint8_t header = (ring_peek(ix) & TRACE_FLAG_ABSOLUTE) ? 6 : 4;
+
+  entry->type = ring_peek(ix) & TRACE_TYPE_MASK;
+  entry->time = cursor->time;
+  entry->len = len - header;
+  for (uint8_t i = 0; i < entry->len; i++) {
+    entry->data[i] = ring_peek(ix + header + i);
+  }
+
+  cursor->ix += len;
+  return true;
+}
+
+static void hex_writer(uint8_t const *data, size_t len, void *ctx) {
+  uint32_t *column = (uint32_t *)ctx;
+  for (size_t i = 0; i < len; i++) {
+    printf("%02x", data[i]);
+    if (++*column == 32) {
+      printf("\n");
+      *column = 0;
+      // Dumping the whole ring takes seconds at 115200 baud.
+      crash_watchdog_feed();
+    }
+  }
+}
+
+void trace_dump() {
+  bool was_running = trace_running;
+  trace_running = false;
+
+  uint32_t column = 0;
+  printf("\nTRACE BEGIN %lu\n", trace_records);
+  trace_serialize(hex_writer, &column);
+  if (column != 0) {
+    printf("\n");
+  }
+  printf("TRACE END\n");
+
+  trace_running = was_running;
+}
+
+void trace_print_stats() {
+  printf("Trace: %s, %lu records, %lu of %d bytes used, %lu dropped\n",
+    trace_running ? "capturing" : "stopped", trace_records,
+    trace_head - trace_tail, RMK_TRACE_BUFFER_SIZE, trace_dropped);
+}
+
+#endif
@@ -0,0 +1,111 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include "pico/stdlib.h"
+#include "config.h"
+
+// Capture of everything that goes over the pogo line and of the HID reports
+// we get from the keyboard, with microsecond timestamps, into a RAM ring.
+// Once the ring is full, the oldest records are dropped.
+//
+// The binary format, all values little endian:
+//
+//   Header: "RMKT", uint8_t version, 3 reserved bytes, uint32_t start time
+//           in us, uint32_t number of records.
+//   Record: uint8_t type, time, uint8_t length, length bytes of payload.
+//
+// The time is a uint16_t delta in us to the previous record (to the start
+// time for the first record). If bit 7 of the type is set, it's an absolute
+// uint32_t timestamp instead.
+//
+// Payloads:
+//   TRACE_POGO_RX/TX: The bytes as they went over the line.
+//   TRACE_HID_MOUNT:  dev_addr, instance, report count and then for every
+//                     report its tuh_hid_report_info_t (report ID, usage,
+//                     usage page low byte, usage page high byte).
+//   TRACE_HID_REPORT: dev_addr, instance and the report as it was passed to
+//                     tuh_hid_report_received_cb.
+
+#define TRACE_MAGIC "RMKT"
+#define TRACE_VERSION 1
+#define TRACE_HEADER_LEN 16
+
+#define TRACE_TYPE_MASK 0x7f
+#define TRACE_FLAG_ABSOLUTE 0x80
+
+typedef enum trace_type {
+  TRACE_POGO_RX = 0x01,
+  TRACE_POGO_TX = 0x02,
+  TRACE_HID_MOUNT = 0x03,
+  TRACE_HID_REPORT = 0x04
+} trace_type_t;
+
+#define TRACE_MAX_PAYLOAD 255
+
+typedef struct trace_entry {
+  trace_type_t type;
+  uint32_t time;
+  uint8_t len;
+  uint8_t data[TRACE_MAX_PAYLOAD];
+} trace_entry_t;
+
+// Position in the ring for walking over the records with trace_next.
+typedef struct trace_cursor {
+  uint32_t ix;
+  uint32_t time;
+} trace_cursor_t;
+
+// Receives the serialized trace in chunks.
+typedef void (*trace_writer_t)(uint8_t const *data, size_t len, void *ctx);
+
+#if RMK_TRACE
+
+void trace_start();
+void trace_stop();
+bool trace_is_running();
+
+void trace_record(trace_type_t type, uint8_t const *data, uint8_t len);
+
+// Serializes the current contents of the ring in the format above.
+void trace_serialize(trace_writer_t writer, void *ctx);
+
+// Prints the trace as hex on stdio, between "TRACE BEGIN" and "TRACE END"
+// lines. scripts/trace_extract.py turns that back into a binary file.
+void trace_dump();
+
+void trace_print_stats();
+
+// Walks over the records, oldest first. Don't record anything while walking,
+// since that might evict the records the cursor points to.
+void trace_cursor_init(trace_cursor_t *cursor);
+bool trace_next(trace_cursor_t *cursor, trace_entry_t *entry);
+
+#else
+
+static inline void trace_start() {}
+static inline void trace_stop() {}
+static inline bool trace_is_running() { return false; }
+static inline void trace_record(trace_type_t type, uint8_t const *data, uint8_t len) {}
+static inline void trace_serialize(trace_writer_t writer, void *ctx) {}
+static inline void trace_dump() {}
+static inline void trace_print_stats() {}
+static inline void trace_cursor_init(trace_cursor_t *cursor) {}
+static inline bool trace_next(trace_cursor_t *cursor, trace_entry_t *entry) { return false; }
+
+#endif
+
+#endif
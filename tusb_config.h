@@ -26,6 +26,8 @@
 #ifndef _TUSB_CONFIG_H_
 #define _TUSB_CONFIG_H_
 
+#include "config.h"
+
 #ifdef __cplusplus
  extern "C" {
 #endif
@@ -39,15 +41,31 @@
   #error CFG_TUSB_MCU must be defined
 #endif
 
-#if CFG_TUSB_MCU == OPT_MCU_LPC43XX || CFG_TUSB_MCU == OPT_MCU_LPC18XX || CFG_TUSB_MCU == OPT_MCU_MIMXRT10XX
+#if RMK_PIO_USB_HOST
+  // The keyboard is on the PIO port, the native controller is the CDC device
+  // for the debug console.
+  #define CFG_TUSB_RHPORT0_MODE       OPT_MODE_DEVICE
+  #define CFG_TUSB_RHPORT1_MODE       OPT_MODE_HOST
+  #define CFG_TUH_RPI_PIO_USB         1
+  #define BOARD_TUD_RHPORT            0
+  #define BOARD_TUH_RHPORT            1
+#elif CFG_TUSB_MCU == OPT_MCU_LPC43XX || CFG_TUSB_MCU == OPT_MCU_LPC18XX || CFG_TUSB_MCU == OPT_MCU_MIMXRT10XX
   #define CFG_TUSB_RHPORT0_MODE       (OPT_MODE_HOST | OPT_MODE_HIGH_SPEED)
 #else
   #define CFG_TUSB_RHPORT0_MODE       OPT_MODE_HOST
 #endif
 
+#ifndef BOARD_TUH_RHPORT
+  #define BOARD_TUH_RHPORT            0
+#endif
+
 #ifndef CFG_TUSB_OS
+#if RMK_FREERTOS
+#define CFG_TUSB_OS                 OPT_OS_FREERTOS
+#else
 #define CFG_TUSB_OS                 OPT_OS_NONE
 #endif
+#endif
 
 #define CFG_TUH_ENABLED 1
 #define CFG_TUH_MAX_SPEED OPT_MODE_DEFAULT_SPEED
@@ -90,6 +108,25 @@
 #define CFG_TUH_HID_EP_BUFSIZE      64
 #define CFG_TUH_HID_EPOUT_BUFSIZE   64
 
+//------------- CDC device -------------//
+
+#if RMK_PIO_USB_HOST
+#define CFG_TUD_ENABLED             1
+#define CFG_TUD_ENDPOINT0_SIZE      64
+
+#define CFG_TUD_CDC                 1
+#define CFG_TUD_HID                 0
+#define CFG_TUD_MSC                 0
+#define CFG_TUD_MIDI                0
+#define CFG_TUD_VENDOR              0
+
+// The TX FIFO takes what's printed between two runs of tud_task, and a
+// statistics dump while no terminal is attached.
+#define CFG_TUD_CDC_RX_BUFSIZE      64
+#define CFG_TUD_CDC_TX_BUFSIZE      2048
+#define CFG_TUD_CDC_EP_BUFSIZE      64
+#endif
+
 #ifdef __cplusplus
  }
 #endif
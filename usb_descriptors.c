@@ -0,0 +1,122 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * USB keyboard adapter for reMarkable 2.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any
+ * kind, whether express or implied; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <string.h>
+#include "pico/stdlib.h"
+
+#include "config.h"
+#include "tusb.h"
+
+// Descriptors of the CDC device on the native USB port with RMK_PIO_USB_HOST
+// (see cdc_stdio.h).
+
+#if RMK_PIO_USB_HOST
+
+#include "pico/unique_id.h"
+
+// The SDK's VID and PID for a CDC stdio device, so the same udev rules apply.
+#define USB_VID 0x2e8a
+#define USB_PID 0x000a
+
+enum {
+  ITF_NUM_CDC = 0,
+  ITF_NUM_CDC_DATA,
+  ITF_NUM_TOTAL
+};
+
+#define EPNUM_CDC_NOTIF 0x81
+#define EPNUM_CDC_OUT 0x02
+#define EPNUM_CDC_IN 0x82
+
+#define CONFIG_TOTAL_LEN (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN)
+
+enum {
+  STRING_LANGUAGE = 0,
+  STRING_MANUFACTURER,
+  STRING_PRODUCT,
+  STRING_SERIAL,
+  STRING_CDC
+};
+
+static const tusb_desc_device_t device_descriptor = {
+  .bLength = sizeof(tusb_desc_device_t),
+  .bDescriptorType = TUSB_DESC_DEVICE,
+  .bcdUSB = 0x0200,
+  // Interface association, for the two CDC interfaces.
+  .bDeviceClass = TUSB_CLASS_MISC,
+  .bDeviceSubClass = MISC_SUBCLASS_COMMON,
+  .bDeviceProtocol = MISC_PROTOCOL_IAD,
+  .bMaxPacketSize0 = CFG_TUD_ENDPOINT0_SIZE,
+  .idVendor = USB_VID,
+  .idProduct = USB_PID,
+  .bcdDevice = 0x0100,
+  .iManufacturer = STRING_MANUFACTURER,
+  .iProduct = STRING_PRODUCT,
+  .iSerialNumber = STRING_SERIAL,
+  .bNumConfigurations = 1
+};
+
+static const uint8_t configuration_descriptor[] = {
+  TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN, 0, 100),
+  TUD_CDC_DESCRIPTOR(ITF_NUM_CDC, STRING_CDC, EPNUM_CDC_NOTIF, 8, EPNUM_CDC_OUT, EPNUM_CDC_IN,
+    CFG_TUD_CDC_EP_BUFSIZE),
+};
+
+static const char *const strings[] = {
+  [STRING_MANUFACTURER] = "rM keyboard adapter",
+  [STRING_PRODUCT] = "rM keyboard adapter console",
+  [STRING_CDC] = "Console"
+};
+
+// UTF-16, with the descriptor header in the first element.
+#define MAX_STRING_LENGTH 32
+static uint16_t string_descriptor[MAX_STRING_LENGTH + 1];
+
+uint8_t const *tud_descriptor_device_cb() {
+  return (uint8_t const *)&device_descriptor;
+}
+
+uint8_t const *tud_descriptor_configuration_cb(uint8_t index) {
+  return configuration_descriptor;
+}
+
+uint16_t const *tud_descriptor_string_cb(uint8_t index, uint16_t langid) {
+  char serial[2 * PICO_UNIQUE_BOARD_ID_SIZE_BYTES + 1];
+  char const *string;
+  uint8_t length;
+
+  if (index == STRING_LANGUAGE) {
+    string_descriptor[1] = 0x0409; // English (US)
+    length = 1;
+  } else {
+    if (index == STRING_SERIAL) {
+      pico_get_unique_board_id_string(serial, sizeof(serial));
+      string = serial;
+    } else if (index < sizeof(strings) / sizeof(strings[0]) && strings[index] != NULL) {
+      string = strings[index];
+    } else {
+      return NULL;
+    }
+
+    length = MIN(strlen(string), MAX_STRING_LENGTH);
+    for (uint8_t i = 0; i < length; i++) {
+      string_descriptor[1 + i] = string[i];
+    }
+  }
+
+  string_descriptor[0] = (TUSB_DESC_STRING << 8) | (2 * length + 2);
+  return string_descriptor;
+}
+
+#endif
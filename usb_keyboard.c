@@ -12,48 +12,372 @@
  * GNU General Public License for more details.
  */
 
+#include <stdio.h>
+#include <string.h>
+
 #include "usb_keyboard.h"
+#include "host/hcd.h"
 #include "pico/stdlib.h"
 #include "app.h"
+#include "config.h"
+#include "hid_cache.h"
+#include "trace.h"
+#include "hot_path.h"
+#include "clock_scaling.h"
+
+#if RMK_PIO_USB_HOST
+#include "pio_usb.h"
+#endif
 
 // TinyUSB sends us reports about HID deviceEs. Each HID device instance can have
 // multiple reports. We need to store these reports somewhere, which is what
 // hid_report_count and hid_report_info are for. CFG_TUH_HID is the maximum
 // number of HID devices supported by TinyUSB. It's defined in tusb_config.h
-#define MAX_REPORT 4
+// MAX_REPORT is defined in hid_cache.h.
 static uint8_t hid_report_count[CFG_TUH_HID];
 static tuh_hid_report_info_t hid_report_info[CFG_TUH_HID][MAX_REPORT];
+static uint8_t hid_dev_addr[CFG_TUH_HID];
 
 #define MAX_KEY 6
 
+// Polling intervals of the interrupt endpoints, indexed by device address.
+// We keep both what the device asked for and what we actually configured.
+static uint8_t ep_interval_advertised[CFG_TUSB_HOST_DEVICE_MAX + 1];
+static uint8_t ep_interval_polled[CFG_TUSB_HOST_DEVICE_MAX + 1];
+
+// Header of the configuration descriptor, to see whether the device supports
+// remote wakeup. Indexed by device address as well.
+static tusb_desc_configuration_t config_desc[CFG_TUSB_HOST_DEVICE_MAX + 1];
+
+// Measured time between two reports of the same HID instance.
+static usb_report_stats_t report_stats[CFG_TUH_HID];
+
+// Timing of the most recent hot plug on the root port.
+static usb_hotplug_stats_t hotplug_stats;
+static bool port_connected = false;
+
+// State of a replay of captured HID reports.
+static bool replay_running = false;
+static bool replay_realtime;
+static trace_cursor_t replay_cursor;
+static uint64_t replay_start_us;
+static uint32_t replay_first_time;
+static bool replay_have_first;
+static uint32_t replay_reports;
+// Report layouts from the capture, used instead of the mounted ones.
+static uint8_t replay_report_count[CFG_TUH_HID];
+static tuh_hid_report_info_t replay_report_info[CFG_TUH_HID][MAX_REPORT];
+
 void hid_app_task() {
 }
 
+void usb_host_configure() {
+#if RMK_PIO_USB_HOST
+  // The default configuration puts the TX state machine on pio0 and RX on
+  // pio1, all three programs don't fit into one block.
+  pio_usb_configuration_t pio_config = PIO_USB_DEFAULT_CONFIG;
+  pio_config.pin_dp = PIO_USB_DP_PIN;
+  tuh_configure(BOARD_TUH_RHPORT, TUH_CFGID_RPI_PIO_USB_CONFIGURATION, &pio_config);
+#endif
+}
+
+void usb_init() {
+  hid_cache_init();
+}
+
+void usb_task() {
+  // TinyUSB doesn't tell us about a connect until enumeration has finished,
+  // so we watch the root port ourselves to know when the plug went in.
+  bool connected = hcd_port_connect_status(BOARD_TUH_RHPORT);
+  if (connected && !port_connected) {
+    hotplug_stats = (usb_hotplug_stats_t){ .connect_us = time_us_64() };
+  }
+  port_connected = connected;
+}
+
+usb_hotplug_stats_t const *usb_get_hotplug_stats() {
+  return &hotplug_stats;
+}
+
+void usb_print_hotplug_stats() {
+  if (hotplug_stats.mount_us == 0) {
+    return;
+  }
+
+  printf("USB: Plug-in to mount %lu us, descriptor %s in %lu us, mount to first key ",
+    hotplug_stats.enumeration_us, hotplug_stats.cache_hit ? "cached" : "parsed",
+    hotplug_stats.parse_us);
+  if (hotplug_stats.waiting_for_key) {
+    printf("pending");
+  } else {
+    printf("%lu us", hotplug_stats.first_key_us);
+  }
+  printf(", remote wakeup %s\n", hotplug_stats.remote_wakeup ? "on" : "off");
+}
+
+// TinyUSB opens the HID endpoints before it calls tuh_hid_mount_cb, using the
+// bInterval from the endpoint descriptor as is. There's no hook for changing
+// that, so we wrap the HCD function at link time (see -Wl,--wrap in
+// CMakeLists.txt) and lower the interval for interrupt IN endpoints there.
+bool __real_hcd_edpt_open(uint8_t rhport, uint8_t dev_addr, tusb_desc_endpoint_t const *ep_desc);
+
+bool __wrap_hcd_edpt_open(uint8_t rhport, uint8_t dev_addr, tusb_desc_endpoint_t const *ep_desc) {
+  if (ep_desc->bmAttributes.xfer != TUSB_XFER_INTERRUPT ||
+      tu_edpt_dir(ep_desc->bEndpointAddress) != TUSB_DIR_IN) {
+    return __real_hcd_edpt_open(rhport, dev_addr, ep_desc);
+  }
+
+  tusb_desc_endpoint_t desc = *ep_desc;
+#if RMK_USB_POLL_INTERVAL_MS > 0
+  if (desc.bInterval > RMK_USB_POLL_INTERVAL_MS) {
+    desc.bInterval = RMK_USB_POLL_INTERVAL_MS;
+  }
+#endif
+
+  if (dev_addr <= CFG_TUSB_HOST_DEVICE_MAX) {
+    ep_interval_advertised[dev_addr] = ep_desc->bInterval;
+    ep_interval_polled[dev_addr] = desc.bInterval;
+  }
+  printf("USB: Device %d endpoint %x interval %d ms (advertised %d ms)\n",
+    dev_addr, ep_desc->bEndpointAddress, desc.bInterval, ep_desc->bInterval);
+
+  return __real_hcd_edpt_open(rhport, dev_addr, &desc);
+}
+
+static void RMK_HOT(record_report_time)(uint8_t dev_addr, uint8_t instance) {
+  usb_report_stats_t *stats = &report_stats[instance];
+  uint64_t now = time_us_64();
+
+  if (stats->dev_addr != dev_addr) {
+    // A different device took over this instance, start over.
+    *stats = (usb_report_stats_t){ .dev_addr = dev_addr };
+  }
+
+  if (stats->report_count > 0) {
+    uint32_t interval = (uint32_t)(now - stats->last_report_us);
+    if (stats->report_count == 1 || interval < stats->min_interval_us) {
+      stats->min_interval_us = interval;
+    }
+    if (interval > stats->max_interval_us) {
+      stats->max_interval_us = interval;
+    }
+    stats->total_interval_us += interval;
+  }
+
+  stats->report_count++;
+  stats->last_report_us = now;
+}
+
+usb_report_stats_t const *usb_get_report_stats(uint8_t instance) {
+  if (instance >= CFG_TUH_HID || report_stats[instance].report_count == 0) {
+    return NULL;
+  }
+  return &report_stats[instance];
+}
+
+void usb_print_report_stats() {
+  for (uint8_t i = 0; i < CFG_TUH_HID; i++) {
+    usb_report_stats_t const *stats = usb_get_report_stats(i);
+    if (stats == NULL) {
+      continue;
+    }
+
+    uint8_t dev_addr = stats->dev_addr;
+    uint32_t avg = 0;
+    if (stats->report_count > 1) {
+      avg = (uint32_t)(stats->total_interval_us / (stats->report_count - 1));
+    }
+    printf("USB: Device %d instance %d: %lu reports, interval min %lu us avg %lu us max %lu us",
+      dev_addr, i, stats->report_count, stats->min_interval_us, avg, stats->max_interval_us);
+    if (dev_addr <= CFG_TUSB_HOST_DEVICE_MAX && ep_interval_polled[dev_addr] > 0) {
+      printf(" (polled at %d ms, advertised %d ms)",
+        ep_interval_polled[dev_addr], ep_interval_advertised[dev_addr]);
+    }
+    printf("\n");
+  }
+}
+
+static void trace_layout(uint8_t instance) {
+  uint8_t data[3 + MAX_REPORT * 4];
+  uint8_t len = 0;
+
+  data[len++] = hid_dev_addr[instance];
+  data[len++] = instance;
+  data[len++] = hid_report_count[instance];
+  for (uint8_t i = 0; i < hid_report_count[instance] && i < MAX_REPORT; i++) {
+    tuh_hid_report_info_t const *info = &hid_report_info[instance][i];
+    data[len++] = info->report_id;
+    data[len++] = info->usage;
+    data[len++] = info->usage_page & 0xff;
+    data[len++] = info->usage_page >> 8;
+  }
+
+  trace_record(TRACE_HID_MOUNT, data, len);
+}
+
+void usb_trace_layouts() {
+  for (uint8_t i = 0; i < CFG_TUH_HID; i++) {
+    if (hid_report_count[i] > 0) {
+      trace_layout(i);
+    }
+  }
+}
+
+static void remote_wakeup_set(tuh_xfer_t *xfer) {
+  if (xfer->result != XFER_RESULT_SUCCESS) {
+    printf("USB: Device %d didn't accept remote wakeup\n", xfer->daddr);
+    return;
+  }
+  printf("USB: Remote wakeup enabled on device %d\n", xfer->daddr);
+  hotplug_stats.remote_wakeup = true;
+}
+
+static void config_desc_received(tuh_xfer_t *xfer) {
+  uint8_t daddr = xfer->daddr;
+  if (xfer->result != XFER_RESULT_SUCCESS ||
+      !(config_desc[daddr].bmAttributes & TUSB_DESC_CONFIG_ATT_REMOTE_WAKEUP)) {
+    return;
+  }
+
+  // A device only signals resume while suspended if the host has allowed it
+  // to, which power_suspend relies on to wake up on a key press.
+  static tusb_control_request_t const request = {
+    .bmRequestType_bit = {
+      .recipient = TUSB_REQ_RCPT_DEVICE,
+      .type = TUSB_REQ_TYPE_STANDARD,
+      .direction = TUSB_DIR_OUT
+    },
+    .bRequest = TUSB_REQ_SET_FEATURE,
+    .wValue = TUSB_REQ_FEATURE_REMOTE_WAKEUP,
+    .wIndex = 0,
+    .wLength = 0
+  };
+  tuh_xfer_t set_feature = {
+    .daddr = daddr,
+    .ep_addr = 0,
+    .setup = &request,
+    .buffer = NULL,
+    .complete_cb = remote_wakeup_set,
+    .user_data = 0
+  };
+  tuh_control_xfer(&set_feature);
+}
+
+// TinyUSB calls this once a device is configured and its class drivers are
+// mounted.
+void tuh_mount_cb(uint8_t daddr) {
+  if (daddr > CFG_TUSB_HOST_DEVICE_MAX) {
+    return;
+  }
+  tuh_descriptor_get_configuration(daddr, 0, &config_desc[daddr], sizeof(config_desc[daddr]),
+    config_desc_received, 0);
+}
+
 // TinyUSB calls this when a new device with an HID interface is mounted.
 void tuh_hid_mount_cb(uint8_t dev_addr, uint8_t instance, uint8_t const *desc_report, uint16_t desc_len) {
   printf("USB: Device mounted\n");
-  hid_report_count[instance] = tuh_hid_parse_report_descriptor(
-    hid_report_info[instance],
-    MAX_REPORT,
-    desc_report,
-    desc_len
-  );
+  uint64_t start = time_us_64();
+
+  // Re-plugging a keyboard we've seen before doesn't need another pass over
+  // the report descriptor.
+  uint16_t vid = 0, pid = 0;
+  tuh_vid_pid_get(dev_addr, &vid, &pid);
+  hid_cache_entry_t const *cached = hid_cache_lookup(vid, pid, instance, desc_len);
+
+  if (cached != NULL) {
+    hid_report_count[instance] = cached->report_count;
+    memcpy(hid_report_info[instance], cached->report_info, sizeof(cached->report_info));
+  } else {
+    hid_report_count[instance] = tuh_hid_parse_report_descriptor(
+      hid_report_info[instance],
+      MAX_REPORT,
+      desc_report,
+      desc_len
+    );
+
+    hid_cache_entry_t entry = {
+      .vid = vid,
+      .pid = pid,
+      .instance = instance,
+      .report_count = hid_report_count[instance],
+      .desc_len = desc_len
+    };
+    memcpy(entry.report_info, hid_report_info[instance], sizeof(entry.report_info));
+    hid_cache_store(&entry);
+  }
+
+  hid_dev_addr[instance] = dev_addr;
+  trace_layout(instance);
+
+  uint64_t now = time_us_64();
+  hotplug_stats.mount_us = now;
+  hotplug_stats.parse_us = (uint32_t)(now - start);
+  hotplug_stats.cache_hit = cached != NULL;
+  hotplug_stats.waiting_for_key = true;
+  if (hotplug_stats.connect_us != 0) {
+    hotplug_stats.enumeration_us = (uint32_t)(start - hotplug_stats.connect_us);
+  }
 
   // We need to tell TinyUSB that we're interested in further reports for this.
   tuh_hid_receive_report(dev_addr, instance);
 }
 
+static bool is_keyboard_instance(uint8_t instance) {
+  for (uint8_t i = 0; i < hid_report_count[instance]; i++) {
+    if (hid_report_info[instance][i].usage_page == HID_USAGE_PAGE_DESKTOP &&
+        hid_report_info[instance][i].usage == HID_USAGE_DESKTOP_KEYBOARD) {
+      return true;
+    }
+  }
+  return false;
+}
+
 // TinyUSB calls with when a device with an HID interface is unmounted.
 void tuh_hid_umount_cb(uint8_t dev_addr, uint8_t instance) {
   printf("USB: Device unmounted\n");
+
+  if (is_keyboard_instance(instance)) {
+    // Release everything that was still held down, otherwise the reMarkable
+    // would see those keys as stuck.
+    static hid_keyboard_report_t const empty_report = {0, 0, {0}};
+    usb_process_keyboard_report(&empty_report);
+  }
+
+  hid_report_count[instance] = 0;
+  memset(hid_report_info[instance], 0, sizeof(hid_report_info[instance]));
+  report_stats[instance] = (usb_report_stats_t){0};
 }
 
 // TinyUSB calls this when we receive a report from a mounted HID device. The
 // report contains information about the keys that have been pressed.
-void tuh_hid_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t const *report, uint16_t len) {
-  uint8_t const report_count = hid_report_count[instance];
-  tuh_hid_report_info_t *report_infos = hid_report_info[instance];
-  tuh_hid_report_info_t *report_info = NULL;
+void RMK_HOT(tuh_hid_report_received_cb)(uint8_t dev_addr, uint8_t instance, uint8_t const *report, uint16_t len) {
+  clock_scaling_activity();
+  record_report_time(dev_addr, instance);
+
+  if (trace_is_running()) {
+    uint8_t data[2 + CFG_TUH_HID_EP_BUFSIZE];
+    uint16_t data_len = len < CFG_TUH_HID_EP_BUFSIZE ? len : CFG_TUH_HID_EP_BUFSIZE;
+    data[0] = dev_addr;
+    data[1] = instance;
+    memcpy(data + 2, report, data_len);
+    trace_record(TRACE_HID_REPORT, data, 2 + data_len);
+  }
+
+  xip_profile_begin();
+  usb_handle_hid_report(instance, report, len);
+  xip_profile_end(XIP_PROBE_HID_REPORT);
+
+  // Request to receive further reports.
+  tuh_hid_receive_report(dev_addr, instance);
+}
+
+static void RMK_HOT(handle_report)(uint8_t report_count, tuh_hid_report_info_t const *report_infos,
+    uint8_t const *report, uint16_t len) {
+  if (len == 0) {
+    return;
+  }
+
+  tuh_hid_report_info_t const *report_info = NULL;
 
   if (report_count == 1 && report_infos[0].report_id == 0) {
     // Simple report.
@@ -77,9 +401,107 @@ void tuh_hid_report_received_cb(uint8_t dev_addr, uint8_t instance, uint8_t cons
       report_info->usage == HID_USAGE_DESKTOP_KEYBOARD) {
     usb_process_keyboard_report((hid_keyboard_report_t const *)report);
   }
+}
 
-  // Request to receive further reports.
-  tuh_hid_receive_report(dev_addr, instance);
+void RMK_HOT(usb_handle_hid_report)(uint8_t instance, uint8_t const *report, uint16_t len) {
+  if (instance >= CFG_TUH_HID) {
+    return;
+  }
+  handle_report(hid_report_count[instance], hid_report_info[instance], report, len);
+}
+
+// Takes the layout of an instance from a TRACE_HID_MOUNT record into the
+// replay table.
+static bool replay_load_layout(trace_entry_t const *entry) {
+  if (entry->len < 3 || entry->data[1] >= CFG_TUH_HID) {
+    return false;
+  }
+
+  uint8_t instance = entry->data[1];
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < entry->data[2] && i < MAX_REPORT && 3 + 4 * i + 3 < entry->len; i++) {
+    uint8_t const *info = entry->data + 3 + 4 * i;
+    replay_report_info[instance][i] = (tuh_hid_report_info_t){
+      .report_id = info[0],
+      .usage = info[1],
+      .usage_page = info[2] | (info[3] << 8)
+    };
+    count++;
+  }
+  replay_report_count[instance] = count;
+  return true;
+}
+
+void usb_replay_start(bool realtime) {
+  // The capture has to stand still while we walk over it.
+  trace_stop();
+
+  // Reports are parsed with the layouts that were recorded along with them,
+  // not with whatever keyboard is plugged in now. The capture starts with
+  // them (see usb_trace_layouts), later ones are picked up during the replay.
+  memset(replay_report_count, 0, sizeof(replay_report_count));
+  bool have_layout = false;
+  trace_entry_t entry;
+  trace_cursor_init(&replay_cursor);
+  while (trace_next(&replay_cursor, &entry)) {
+    if (entry.type == TRACE_HID_REPORT) {
+      break;
+    }
+    if (entry.type == TRACE_HID_MOUNT && replay_load_layout(&entry)) {
+      have_layout = true;
+    }
+  }
+  if (!have_layout) {
+    printf("USB: ERROR: No report layout in the capture, can't replay it\n");
+    return;
+  }
+
+  trace_cursor_init(&replay_cursor);
+  replay_realtime = realtime;
+  replay_start_us = time_us_64();
+  replay_have_first = false;
+  replay_reports = 0;
+  replay_running = true;
+  printf("USB: Replaying captured reports%s\n", realtime ? " with original timing" : "");
+}
+
+void usb_replay_task() {
+  if (!replay_running) {
+    return;
+  }
+
+  // Like tuh_task, hand over at most one report per main loop iteration.
+  static trace_entry_t entry;
+  static bool entry_pending = false;
+
+  while (!entry_pending) {
+    if (!trace_next(&replay_cursor, &entry)) {
+      replay_running = false;
+      printf("USB: Replay finished, %lu reports\n", replay_reports);
+      return;
+    }
+    if (entry.type == TRACE_HID_MOUNT) {
+      replay_load_layout(&entry);
+    }
+    entry_pending = entry.type == TRACE_HID_REPORT && entry.len > 2;
+  }
+
+  if (!replay_have_first) {
+    replay_first_time = entry.time;
+    replay_have_first = true;
+  }
+  if (replay_realtime &&
+      time_us_64() - replay_start_us < (uint32_t)(entry.time - replay_first_time)) {
+    return;
+  }
+
+  entry_pending = false;
+  replay_reports++;
+  uint8_t instance = entry.data[1];
+  if (instance < CFG_TUH_HID) {
+    handle_report(replay_report_count[instance], replay_report_info[instance],
+      entry.data + 2, entry.len - 2);
+  }
 }
 
 static inline bool find_key_in_report(hid_keyboard_report_t const *report, uint8_t keycode) {
@@ -106,14 +528,20 @@ static inline bool find_mod_in_report(hid_keyboard_report_t const *report, uint8
 // will be created.
 static key_event_t tmp_key_event;
 
-void publish_key_event(key_event_type_t type, uint8_t key) {
+void RMK_HOT(publish_key_event)(key_event_type_t type, uint8_t key) {
   tmp_key_event.type = type;
   tmp_key_event.keycode = key;
 
+  if (hotplug_stats.waiting_for_key && app_state.mode == APP_KEYBOARD) {
+    hotplug_stats.waiting_for_key = false;
+    hotplug_stats.first_key_us = (uint32_t)(time_us_64() - hotplug_stats.mount_us);
+    usb_print_hotplug_stats();
+  }
+
   app_push_key_event(tmp_key_event);
 }
 
-void usb_process_keyboard_report(hid_keyboard_report_t const *report) {
+void RMK_HOT(usb_process_keyboard_report)(hid_keyboard_report_t const *report) {
   static hid_keyboard_report_t prev_report = {0, 0, {0}};
 
   for (uint8_t i = 0; i < MAX_KEY; i++) {
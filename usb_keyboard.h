@@ -18,6 +18,63 @@
 #include "tusb_config.h"
 #include "tusb.h"
 
+// Timing of the reports received from one HID instance. Since we only ever
+// get reports once per polling interval, these reflect the real polling rate
+// of the device rather than what it advertises.
+typedef struct usb_report_stats {
+  uint8_t dev_addr;
+  uint32_t report_count;
+  uint64_t last_report_us;
+  uint32_t min_interval_us;
+  uint32_t max_interval_us;
+  uint64_t total_interval_us;
+} usb_report_stats_t;
+
+// Timing of the last keyboard hot plug: from the root port seeing the device
+// to tuh_hid_mount_cb, how long setting up the report layout took and from
+// there to the first key that was forwarded to the reMarkable.
+typedef struct usb_hotplug_stats {
+  uint64_t connect_us;
+  uint64_t mount_us;
+  uint32_t enumeration_us;
+  uint32_t parse_us;
+  uint32_t first_key_us;
+  bool cache_hit;
+  bool waiting_for_key;
+  bool remote_wakeup; // The keyboard may wake us up from suspend.
+} usb_hotplug_stats_t;
+
+// D+ of the PIO USB host port with RMK_PIO_USB_HOST, D- is the next pin.
+#define PIO_USB_DP_PIN 2
+
+// Port setup that has to happen before tusb_init.
+void usb_host_configure();
+void usb_init();
+// Call this from the main loop, after tuh_task.
+void usb_task();
+
 void usb_process_keyboard_report(hid_keyboard_report_t const *report);
 
+// Routes a report as received by tuh_hid_report_received_cb, using the report
+// layout of the mounted instance.
+void usb_handle_hid_report(uint8_t instance, uint8_t const *report, uint16_t len);
+
+// Records the report layouts of all mounted instances into the trace. Call
+// this when starting a capture, so that the reports can be replayed without
+// the keyboard.
+void usb_trace_layouts();
+
+// Feeds the HID reports from the trace back through the key pipeline, one per
+// usb_replay_task call, parsed with the report layouts recorded in the trace.
+// This stops the capture. Without a recorded layout, nothing is replayed.
+void usb_replay_start(bool realtime);
+void usb_replay_task();
+
+// Returns NULL if there haven't been any reports for the instance yet.
+usb_report_stats_t const *usb_get_report_stats(uint8_t instance);
+void usb_print_report_stats();
+
+usb_hotplug_stats_t const *usb_get_hotplug_stats();
+void usb_print_hotplug_stats();
+
 #endif